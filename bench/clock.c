@@ -0,0 +1,76 @@
+/*
+ * Compares the compiled clock template against the strftime path that
+ * dwmstatus used before: setenv("TZ") + localtime + strftime per zone.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../dwmstatus.h"
+#include "../config.h"
+
+#define TICKS 200000
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static size_t render_legacy(char *dtbuf, size_t size, time_t now) {
+  char *p = dtbuf;
+  struct tm *tm;
+
+  for (size_t i = 0; i < LENGTH(clocks); i++) {
+    if (clocks[i].zone == NULL) {
+      unsetenv("TZ");
+      tm = localtime(&now);
+    } else if (strcmp(clocks[i].zone, "UTC") == 0) {
+      tm = gmtime(&now);
+    } else {
+      char tz[100];
+      snprintf(tz, sizeof(tz), ":%s", clocks[i].zone);
+      setenv("TZ", tz, 1);
+      tm = localtime(&now);
+    }
+    tm->tm_year += clocks[i].year_offset;
+    p += strftime(p, size - (p - dtbuf), clocks[i].format, tm);
+  }
+  return p - dtbuf;
+}
+
+int main(void) {
+  struct timespec t0, t1;
+  const time_t start = time(NULL);
+  char buf[200];
+  size_t len, sink = 0;
+
+  if (clock_init(clocks, LENGTH(clocks)) == -1)
+    return 1;
+
+  /* both paths have to agree before their timings mean anything */
+  for (time_t now = start; now < start + 86400 * 2; now += 61) {
+    clock_update(now);
+    const char *text = clock_text(&len);
+    if (render_legacy(buf, sizeof(buf), now) != len || memcmp(buf, text, len) != 0) {
+      fprintf(stderr, "mismatch at %ld:\n  strftime: %s\n  template: %.*s\n",
+	      (long) now, buf, (int) len, text);
+      return 1;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (time_t now = start; now < start + TICKS; now++)
+    sink += render_legacy(buf, sizeof(buf), now);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("clock strftime: %8.1f ns/tick\n", elapsed_ns(&t0, &t1) / TICKS);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (time_t now = start + TICKS; now < start + 2 * TICKS; now++) {
+    clock_update(now);
+    sink += clock_text(&len)[0] + len;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("clock template: %8.1f ns/tick\n", elapsed_ns(&t0, &t1) / TICKS);
+
+  return sink == 0;
+}
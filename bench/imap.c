@@ -0,0 +1,140 @@
+/*
+ * Throughput of the mailstatus IMAP parser over recorded server
+ * transcripts (one response per line, LF line ends, turned into CRLF)
+ * and over a large SEARCH result. Each stream is fed in chunks of a few
+ * sizes, from a byte at a time to a full TLS record, which also checks
+ * that the responses come out the same however the input is cut.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../imap.h"
+
+#define STREAM_SIZE (32 << 20)
+#define SEARCH_MAX 100000
+
+struct Count {
+   unsigned long responses, pieces, args;
+};
+
+static const size_t chunks[] = { 1, 1460, 16384 };
+
+static double now_s(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Reads path with every LF turned into CRLF. */
+static char *load(const char *path, size_t *len) {
+   FILE *f = fopen(path, "r");
+   if (f == NULL) {
+      perror(path);
+      exit(1);
+   }
+
+   size_t cap = 4096, n = 0;
+   char *buf = malloc(cap);
+   int ch;
+   while ((ch = getc(f)) != EOF) {
+      if (n + 2 > cap) buf = realloc(buf, cap *= 2);
+      if (ch == '\n') buf[n++] = '\r';
+      buf[n++] = ch;
+   }
+   fclose(f);
+   *len = n;
+   return buf;
+}
+
+/* Repeats one transcript up to about STREAM_SIZE bytes. */
+static char *repeat(const char *t, size_t len, size_t *out) {
+   const size_t times = STREAM_SIZE / len + 1;
+   char *buf = malloc(times * len);
+   for (size_t i = 0; i < times; i++) memcpy(buf + i * len, t, len);
+   *out = times * len;
+   return buf;
+}
+
+static char *big_search(size_t *len) {
+   size_t cap = SEARCH_MAX * 8 + 64, n = 0;
+   char *buf = malloc(cap);
+   n += sprintf(buf, "* SEARCH");
+   for (int i = 1; i <= SEARCH_MAX; i++) n += sprintf(buf + n, " %d", i);
+   n += sprintf(buf + n, "\r\nA3 OK Search completed.\r\n");
+   *len = n;
+   return buf;
+}
+
+static int feed(struct ImapParser *p, const char *s, size_t len, size_t chunk, struct Count *c) {
+   struct ImapResponse r;
+   size_t off = 0;
+
+   imap_reset(p);
+   memset(c, 0, sizeof(*c));
+   while (off < len) {
+      size_t space;
+      char *dst = imap_space(p, &space);
+      size_t n = len - off < chunk ? len - off : chunk;
+      if (n > space) n = space;
+      memcpy(dst, s + off, n);
+      imap_fill(p, n);
+      off += n;
+
+      int rc;
+      while ((rc = imap_next(p, &r)) > 0) {
+         c->pieces++;
+         c->responses += !r.more;
+         c->args += r.nargs;
+      }
+      if (rc < 0) return -1;
+   }
+   return 0;
+}
+
+static void run(struct ImapParser *p, const char *name, const char *s, size_t len) {
+   struct Count first;
+
+   for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+      struct Count c;
+      const double t0 = now_s();
+      if (feed(p, s, len, chunks[i], &c) == -1) {
+         printf("%-16s %6zu  parse error\n", name, chunks[i]);
+         continue;
+      }
+      const double t = now_s() - t0;
+
+      if (i == 0) first = c;
+      const bool same = c.responses == first.responses && c.args == first.args;
+      printf("%-16s %6zu %10.1f %12.0f %10lu %10lu%s\n", name, chunks[i], len / t / 1e6,
+            c.responses / t, c.responses, c.pieces, same ? "" : "  MISMATCH");
+   }
+}
+
+int main(int argc, char *argv[]) {
+   const char *path = argc > 1 ? argv[1] : "bench/imap-session.txt";
+   struct ImapParser p;
+   size_t tlen, len;
+
+   if (imap_init(&p) == -1) {
+      perror("imap_init");
+      return 1;
+   }
+
+   char *t = load(path, &tlen);
+   char *session = repeat(t, tlen, &len);
+   printf("%-16s %6s %10s %12s %10s %10s\n", "stream", "chunk", "MB/s", "responses/s", "responses", "pieces");
+   run(&p, "session", session, len);
+   free(session);
+   free(t);
+
+   t = big_search(&tlen);
+   char *search = repeat(t, tlen, &len);
+   run(&p, "large search", search, len);
+   free(search);
+   free(t);
+
+   imap_free(&p);
+   return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Compares the unseen-message bitmap of mailstatus against the int
+ * array with linear scans it replaced, on a large shared mailbox: the
+ * SEARCH result going in, flag changes, and a storm of EXPUNGEs that
+ * renumber everything above them. Both end with the same set, which is
+ * checked.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../seqset.h"
+
+#define MESSAGES 100000
+#define UNSEEN 20000
+#define FLAG_CHANGES 100000
+#define EXPUNGES 10000
+
+struct Legacy {
+   int *unseens;
+   int cnt;
+   size_t size;
+};
+
+enum Op {Add, Remove, Expunge};
+
+struct Step {
+   enum Op op;
+   unsigned long num;
+};
+
+static double now_ns(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* the former add_unseens, remove_unseens and decrement_unseens */
+static void legacy_add(struct Legacy *l, int num) {
+   int i = 0;
+   for (; i < l->cnt; i++)
+      if (l->unseens[i] == num) return;
+   if ((size_t) i >= l->size) {
+      l->size *= 2;
+      l->unseens = realloc(l->unseens, sizeof(int) * l->size);
+   }
+   l->cnt++;
+   l->unseens[i] = num;
+}
+
+static void legacy_remove(struct Legacy *l, int num) {
+   for (int i = 0; i < l->cnt; i++) {
+      if (l->unseens[i] == num) {
+         l->cnt--;
+         l->unseens[i] = l->unseens[l->cnt];
+         break;
+      }
+   }
+}
+
+static void legacy_decrement(struct Legacy *l, int num) {
+   for (int i = 0; i < l->cnt; i++)
+      if (l->unseens[i] > num) l->unseens[i] -= 1;
+}
+
+static void legacy_run(struct Legacy *l, const struct Step *steps, size_t n) {
+   for (size_t i = 0; i < n; i++) {
+      switch (steps[i].op) {
+         case Add:
+            legacy_add(l, steps[i].num);
+            break;
+         case Remove:
+            legacy_remove(l, steps[i].num);
+            break;
+         case Expunge:
+            legacy_remove(l, steps[i].num);
+            legacy_decrement(l, steps[i].num);
+            break;
+      }
+   }
+}
+
+static void seqset_run(struct SeqSet *s, const struct Step *steps, size_t n) {
+   for (size_t i = 0; i < n; i++) {
+      switch (steps[i].op) {
+         case Add:
+            seqset_add(s, steps[i].num);
+            break;
+         case Remove:
+            seqset_remove(s, steps[i].num);
+            break;
+         case Expunge:
+            seqset_expunge(s, steps[i].num);
+            break;
+      }
+   }
+}
+
+static int compare(const void *a, const void *b) {
+   return *(const int *) a - *(const int *) b;
+}
+
+static int same(struct Legacy *l, const struct SeqSet *s) {
+   if ((size_t) l->cnt != s->count) return 0;
+   qsort(l->unseens, l->cnt, sizeof(int), compare);
+   unsigned long n = 0;
+   for (int i = 0; i < l->cnt; i++)
+      if ((n = seqset_next(s, n)) != (unsigned long) l->unseens[i]) return 0;
+   return 1;
+}
+
+int main(void) {
+   static struct Step search[UNSEEN], flags[FLAG_CHANGES], expunges[EXPUNGES];
+   const struct {
+      const char *name;
+      const struct Step *steps;
+      size_t n;
+   } phases[] = {
+      { "search result", search, UNSEEN },
+      { "flag changes", flags, FLAG_CHANGES },
+      { "expunge storm", expunges, EXPUNGES },
+   };
+
+   /* the unseen messages are the newest ones, as usual */
+   for (size_t i = 0; i < UNSEEN; i++)
+      search[i] = (struct Step) { Add, MESSAGES - UNSEEN + 1 + i };
+   srand(1);
+   for (size_t i = 0; i < FLAG_CHANGES; i++)
+      flags[i] = (struct Step) { rand() % 2 ? Add : Remove, MESSAGES - 2 * UNSEEN + 1 + rand() % (2 * UNSEEN) };
+   for (size_t i = 0; i < EXPUNGES; i++)
+      expunges[i] = (struct Step) { Expunge, 1 + rand() % (MESSAGES - i) };
+
+   struct Legacy l = { malloc(sizeof(int) * 128), 0, 128 };
+   struct SeqSet s;
+   seqset_init(&s);
+
+   printf("%-16s %8s %14s %14s\n", "workload", "ops", "array ns/op", "bitmap ns/op");
+   for (size_t i = 0; i < sizeof(phases) / sizeof(phases[0]); i++) {
+      const double t0 = now_ns();
+      legacy_run(&l, phases[i].steps, phases[i].n);
+      const double t1 = now_ns();
+      seqset_run(&s, phases[i].steps, phases[i].n);
+      const double t2 = now_ns();
+      printf("%-16s %8zu %14.1f %14.1f\n", phases[i].name, phases[i].n, (t1 - t0) / phases[i].n,
+            (t2 - t1) / phases[i].n);
+   }
+
+   printf("%zu unseen left, %s\n", s.count, same(&l, &s) ? "sets match" : "SETS DIFFER");
+   seqset_free(&s);
+   free(l.unseens);
+   return 0;
+}
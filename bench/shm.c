@@ -0,0 +1,133 @@
+/*
+ * Measures producer-to-segment-table latency of a shared-memory slot
+ * update (with eventfd wakeup) against rewriting a file in the status
+ * directory. The child process is the producer, the parent runs the
+ * real dwmstatus sources on an epoll loop.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+#include "../dwmstatus.h"
+#include "../dwmstatus-shm.h"
+
+#define UPDATES 2000
+#define GAP_US 300
+
+static long long samples[2][UPDATES];
+static size_t nsamples[2];
+
+static long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void take(int kind, const char *name) {
+  struct Segment *s = segment_get(name);
+  if (s == NULL || s->len == 0)
+    return;
+
+  char buf[32];
+  const size_t len = s->len < sizeof(buf) - 1 ? s->len : sizeof(buf) - 1;
+  memcpy(buf, s->text, len);
+  buf[len] = '\0';
+  const long long sent = atoll(buf);
+  if (sent > 0 && nsamples[kind] < UPDATES)
+    samples[kind][nsamples[kind]++] = now_ns() - sent;
+  segment_set(s, "", 0);
+}
+
+static void after_batch(void) {
+  take(0, "lat-shm");
+  take(1, "lat-file");
+  if (segment_get("done") != NULL)
+    loop_quit(0);
+}
+
+static void on_dir(int fd, uint32_t events, void *arg) {
+  statusdir_update();
+}
+
+static int cmp(const void *a, const void *b) {
+  const long long x = *(const long long *) a, y = *(const long long *) b;
+  return (x > y) - (x < y);
+}
+
+static void report(const char *label, long long *v, size_t n) {
+  if (n == 0) {
+    printf("%-12s no samples\n", label);
+    return;
+  }
+  long long sum = 0;
+  for (size_t i = 0; i < n; i++)
+    sum += v[i];
+  qsort(v, n, sizeof(*v), cmp);
+  printf("%-12s %5zu updates  mean %7.1f us  p50 %7.1f us  p99 %7.1f us\n", label, n,
+	 sum / 1e3 / n, v[n / 2] / 1e3, v[n * 99 / 100] / 1e3);
+}
+
+static void produce(const char *sock) {
+  struct dwmstatus_shm_client c;
+  char buf[32];
+
+  if (dwmstatus_shm_attach(&c, sock) == -1) {
+    fprintf(stderr, "attach failed\n");
+    _exit(1);
+  }
+  struct dwmstatus_shm_slot *slot = dwmstatus_shm_claim(&c, "lat-shm");
+
+  for (int i = 0; i < UPDATES; i++) {
+    const int len = snprintf(buf, sizeof(buf), "%lld", now_ns());
+    dwmstatus_shm_update(&c, slot, buf, len, true);
+    usleep(GAP_US);
+  }
+  for (int i = 0; i < UPDATES; i++) {
+    const int len = snprintf(buf, sizeof(buf), "%lld", now_ns());
+    const int fd = open("lat-file", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || write(fd, buf, len) != len)
+      _exit(1);
+    close(fd);
+    usleep(GAP_US);
+  }
+
+  const int fd = open("done", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1 || write(fd, "1", 1) != 1)
+    _exit(1);
+  close(fd);
+  _exit(0);
+}
+
+int main(void) {
+  char dir[] = "/tmp/dwmstatus-bench-XXXXXX", sock[64];
+
+  if (mkdtemp(dir) == NULL || chdir(dir) == -1)
+    return 1;
+  snprintf(sock, sizeof(sock), "%s.sock", dir);
+
+  if (loop_init() == -1 || push_open(sock) == -1 || shmseg_open() == -1)
+    return 1;
+  const int dir_fd = statusdir_open(true);
+  if (dir_fd < 0 || loop_add(dir_fd, EPOLLIN, on_dir, NULL) == -1)
+    return 1;
+
+  const pid_t pid = fork();
+  if (pid == 0)
+    produce(sock);
+
+  loop_run(after_batch);
+  waitpid(pid, NULL, 0);
+  push_close();
+
+  report("shm+eventfd", samples[0], nsamples[0]);
+  report("file", samples[1], nsamples[1]);
+
+  unlink("lat-file");
+  unlink("done");
+  rmdir(dir);
+  return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Measures what one dwmstatus tick costs: wall time, system calls and
+ * allocations, across a few status directory and clock setups. Every
+ * scenario runs dwmstatus -o null -b N twice, with N and 2N ticks, and
+ * reports the difference per tick so startup cost drops out. System
+ * calls are counted by tracing the child with ptrace, allocations with
+ * the bench/malloc-count.so preload.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define TIME_TICKS 20000
+#define COUNT_TICKS 500
+#define RUNS 3
+
+struct Scenario {
+  const char *name;
+  const char *binary;
+  int files;
+  size_t file_size;
+  bool poll;
+  bool fresh;
+};
+
+static const struct Scenario scenarios[] = {
+  { "empty dir",            "bench/dwmstatus",       0,  0,     false, false },
+  { "10 files",             "bench/dwmstatus",       10, 16,    false, false },
+  { "10 files, polled",     "bench/dwmstatus",       10, 16,    true,  false },
+  { "10 files, rescanned",  "bench/dwmstatus",       10, 16,    true,  true },
+  { "large files, polled",  "bench/dwmstatus",       10, 65536, true,  false },
+  { "16 zones",             "bench/dwmstatus-zones", 0,  0,     false, false },
+};
+
+static char allocs_path[64];
+
+static long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void make_dir(const char *dir, const struct Scenario *s) {
+  char path[128], *buf = malloc(s->file_size + 1);
+
+  memset(buf, 'x', s->file_size);
+  buf[s->file_size] = '\n';
+  for (int i = 0; i < s->files; i++) {
+    snprintf(path, sizeof(path), "%s/%02d", dir, i);
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || write(fd, buf, s->file_size + 1) == -1)
+      exit(1);
+    close(fd);
+  }
+  free(buf);
+
+  /*
+   * A directory changed in the last seconds is rescanned on every poll;
+   * an mtime in the future keeps it that way for the whole run.
+   */
+  const struct timespec mtime[2] = { { 0, UTIME_OMIT }, { time(NULL) + (s->fresh ? 3600 : -60), 0 } };
+  utimensat(AT_FDCWD, dir, mtime, 0);
+}
+
+static void clear_dir(const char *dir, const struct Scenario *s) {
+  char path[128];
+  for (int i = 0; i < s->files; i++) {
+    snprintf(path, sizeof(path), "%s/%02d", dir, i);
+    unlink(path);
+  }
+}
+
+/* Runs one dwmstatus; mode 't' traces system calls, 'a' preloads the counter. */
+static pid_t start(const struct Scenario *s, const char *dir, long ticks, int mode) {
+  char n[32];
+  snprintf(n, sizeof(n), "%ld", ticks);
+
+  const pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+
+  const int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  if (mode == 'a') {
+    setenv("LD_PRELOAD", "./bench/malloc-count.so", 1);
+    setenv("BENCH_ALLOCS", allocs_path, 1);
+  }
+  if (mode == 't')
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+  if (s->poll)
+    execl(s->binary, s->binary, "-r", "-o", "null", "-b", n, dir, (char *) NULL);
+  else
+    execl(s->binary, s->binary, "-o", "null", "-b", n, dir, (char *) NULL);
+  _exit(127);
+}
+
+static bool finish(pid_t pid) {
+  int status;
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static long long run_time(const struct Scenario *s, const char *dir, long ticks) {
+  long long best = -1;
+  for (int i = 0; i < RUNS; i++) {
+    const long long t0 = now_ns();
+    if (!finish(start(s, dir, ticks, 0)))
+      return -1;
+    const long long t = now_ns() - t0;
+    if (best == -1 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+static long run_syscalls(const struct Scenario *s, const char *dir, long ticks) {
+  const pid_t pid = start(s, dir, ticks, 't');
+  long count = 0;
+  int status, sig = 0;
+  bool entry = true;
+
+  /* the child stops with SIGTRAP at exec */
+  if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status))
+    return -1;
+  ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *) (long) (PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL));
+  while (ptrace(PTRACE_SYSCALL, pid, NULL, (void *) (long) sig) == 0) {
+    if (waitpid(pid, &status, 0) != pid || WIFEXITED(status) || WIFSIGNALED(status))
+      break;
+    sig = 0;
+    if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      count += entry;
+      entry = !entry;
+    } else {
+      sig = WSTOPSIG(status);
+    }
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? count : -1;
+}
+
+static long run_allocs(const struct Scenario *s, const char *dir, long ticks) {
+  char buf[32] = "";
+  if (!finish(start(s, dir, ticks, 'a')))
+    return -1;
+
+  const int fd = open(allocs_path, O_RDONLY);
+  if (fd == -1 || read(fd, buf, sizeof(buf) - 1) <= 0)
+    return -1;
+  close(fd);
+  return atol(buf);
+}
+
+int main(void) {
+  char dir[] = "/tmp/dwmstatus-tick-XXXXXX";
+
+  if (mkdtemp(dir) == NULL)
+    return 1;
+  snprintf(allocs_path, sizeof(allocs_path), "%s.allocs", dir);
+
+  printf("%-22s %12s %14s %14s\n", "scenario", "ns/tick", "syscalls/tick", "allocs/tick");
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    const struct Scenario *s = &scenarios[i];
+    make_dir(dir, s);
+
+    const long long t1 = run_time(s, dir, TIME_TICKS), t2 = run_time(s, dir, 2 * TIME_TICKS);
+    const long c1 = run_syscalls(s, dir, COUNT_TICKS), c2 = run_syscalls(s, dir, 2 * COUNT_TICKS);
+    const long a1 = run_allocs(s, dir, COUNT_TICKS), a2 = run_allocs(s, dir, 2 * COUNT_TICKS);
+    clear_dir(dir, s);
+
+    if (t1 < 0 || t2 < 0 || c1 < 0 || c2 < 0 || a1 < 0 || a2 < 0) {
+      printf("%-22s failed\n", s->name);
+      continue;
+    }
+    printf("%-22s %12.0f %14.2f %14.2f\n", s->name, (double) (t2 - t1) / TIME_TICKS,
+	   (double) (c2 - c1) / COUNT_TICKS, (double) (a2 - a1) / COUNT_TICKS);
+  }
+
+  unlink(allocs_path);
+  rmdir(dir);
+  return 0;
+}
@@ -0,0 +1,23 @@
+/* The user's config.h with the clocks replaced by sixteen zones. */
+#define clocks __attribute__((unused)) unused_clocks
+#include "../config.h"
+#undef clocks
+
+static const struct Clock clocks[] = {
+  { "America/Los_Angeles",  "LAX %R  ",  0 },
+  { "America/Denver",       "DEN %R  ",  0 },
+  { "America/Chicago",      "CHI %R  ",  0 },
+  { "America/New_York",     "NYC %R  ",  0 },
+  { "America/Sao_Paulo",    "SAO %R  ",  0 },
+  { "Atlantic/Reykjavik",   "REK %R  ",  0 },
+  { "Europe/London",        "LON %R  ",  0 },
+  { "Europe/Berlin",        "BER %R  ",  0 },
+  { "Europe/Moscow",        "MOW %R  ",  0 },
+  { "Asia/Dubai",           "DXB %R  ",  0 },
+  { "Asia/Kolkata",         "DEL %R  ",  0 },
+  { "Asia/Bangkok",         "BKK %R  ",  0 },
+  { "Asia/Shanghai",        "SHA %R  ",  0 },
+  { "Asia/Tokyo",           "TYO %R  ",  0 },
+  { "Australia/Sydney",     "SYD %R  ",  0 },
+  { "UTC",                  "%F %T",     0 },
+};
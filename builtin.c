@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "dwmstatus.h"
+
+/*
+ * Native providers for the usual status metrics. Their files stay open
+ * and are re-read with pread; the parsers below work on a stack buffer
+ * and never allocate, so a refresh is usually one system call per file.
+ * /proc/net/dev grows with the interfaces, so it is read into a buffer
+ * kept per provider that doubles until the whole file fits.
+ */
+
+#define MAX_BUILTINS 16
+#define POWER_SUPPLY "/sys/class/power_supply"
+
+struct BuiltinState {
+  const struct Builtin *cfg;
+  struct Segment *segment;
+  int fd, fd2;
+  struct Job job;
+  unsigned long long prev[2];
+  long long prev_ns;
+  char *buf;        /* net only */
+  size_t bufsize;
+};
+
+static struct BuiltinState builtins[MAX_BUILTINS];
+static size_t nbuiltins;
+
+static long long monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Reads fd from offset 0 to EOF, or until buf is full, as a NUL-terminated string. */
+static ssize_t reread(int fd, char *buf, size_t size) {
+  size_t len = 0;
+  ssize_t r = 0;
+  while (len < size - 1) {
+    r = pread(fd, buf + len, size - 1 - len, len);
+    if (r == -1 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      break;
+    len += r;
+  }
+  buf[len] = '\0';
+  return r == -1 ? -1 : (ssize_t) len;
+}
+
+/* As reread into b->buf, growing it until the file fits with room to spare. */
+static ssize_t reread_all(struct BuiltinState *b) {
+  for (;;) {
+    if (b->bufsize > 0) {
+      const ssize_t r = reread(b->fd, b->buf, b->bufsize);
+      if (r < (ssize_t) b->bufsize - 1)
+	return r;
+    }
+    const size_t size = b->bufsize > 0 ? b->bufsize * 2 : 4096;
+    char *buf = realloc(b->buf, size);
+    if (buf == NULL)
+      return -1;
+    b->buf = buf;
+    b->bufsize = size;
+  }
+}
+
+static const char *skip_space(const char *p) {
+  while (*p == ' ' || *p == '\t')
+    p++;
+  return p;
+}
+
+static unsigned long long parse_u64(const char **pp) {
+  const char *p = skip_space(*pp);
+  unsigned long long v = 0;
+  while (*p >= '0' && *p <= '9')
+    v = v * 10 + (*p++ - '0');
+  *pp = p;
+  return v;
+}
+
+/* Value of the "key:" line of /proc/meminfo style text, or 0. */
+static unsigned long long parse_key(const char *text, const char *key) {
+  const size_t len = strlen(key);
+  const char *p = text;
+  while (true) {
+    if (strncmp(p, key, len) == 0 && p[len] == ':') {
+      p += len + 1;
+      return parse_u64(&p);
+    }
+    if ((p = strchr(p, '\n')) == NULL)
+      return 0;
+    p++;
+  }
+}
+
+/* Formats a byte rate as e.g. "980", "12K", "3.4M". */
+static int human(char *buf, size_t size, double v) {
+  static const char units[] = "KMGT";
+  if (v < 1000)
+    return snprintf(buf, size, "%.0f", v);
+  int u = -1;
+  while (v >= 1000 && u < 3) {
+    v /= 1024;
+    u++;
+  }
+  return snprintf(buf, size, v < 10 ? "%.1f%c" : "%.0f%c", v, units[u]);
+}
+
+static int cpu_update(struct BuiltinState *b, char *out, size_t size) {
+  char buf[256];
+  if (reread(b->fd, buf, sizeof(buf)) <= 0 || strncmp(buf, "cpu ", 4) != 0)
+    return -1;
+
+  /* user nice system idle iowait irq softirq steal */
+  const char *p = buf + 4;
+  unsigned long long v[8], total = 0;
+  for (int i = 0; i < 8; i++)
+    total += v[i] = parse_u64(&p);
+  const unsigned long long idle = v[3] + v[4];
+
+  const unsigned long long dt = total - b->prev[0], di = idle - b->prev[1];
+  b->prev[0] = total;
+  b->prev[1] = idle;
+  if (dt == 0)
+    return -1;
+  return snprintf(out, size, "%s%llu%%", b->cfg->label, (dt - di) * 100 / dt);
+}
+
+static int mem_update(struct BuiltinState *b, char *out, size_t size) {
+  char buf[4096];
+  if (reread(b->fd, buf, sizeof(buf)) <= 0)
+    return -1;
+
+  const unsigned long long total = parse_key(buf, "MemTotal");
+  const unsigned long long avail = parse_key(buf, "MemAvailable");
+  if (total == 0)
+    return -1;
+  return snprintf(out, size, "%s%llu%%", b->cfg->label, (total - avail) * 100 / total);
+}
+
+static int battery_update(struct BuiltinState *b, char *out, size_t size) {
+  char cap[16], status[32];
+  if (reread(b->fd, cap, sizeof(cap)) <= 0)
+    return -1;
+
+  char sign = ' ';
+  if (b->fd2 != -1 && reread(b->fd2, status, sizeof(status)) > 0) {
+    if (strncmp(status, "Charging", 8) == 0)
+      sign = '+';
+    else if (strncmp(status, "Discharging", 11) == 0)
+      sign = '-';
+  }
+  const char *p = cap;
+  const unsigned long long pct = parse_u64(&p);
+  return snprintf(out, size, sign == ' ' ? "%s%llu%%" : "%s%llu%%%c", b->cfg->label, pct, sign);
+}
+
+static int net_update(struct BuiltinState *b, char *out, size_t size) {
+  if (reread_all(b) <= 0)
+    return -1;
+  const char *buf = b->buf;
+
+  /* "  iface: rx_bytes 7 more rx fields tx_bytes ..." after two header lines */
+  unsigned long long rx = 0, tx = 0;
+  const char *line = strchr(buf, '\n');
+  line = line != NULL ? strchr(line + 1, '\n') : NULL;
+  for (; line != NULL && line[1] != '\0'; line = strchr(line + 1, '\n')) {
+    const char *name = skip_space(line + 1);
+    const char *colon = strchr(name, ':');
+    if (colon == NULL)
+      break;
+
+    const size_t len = colon - name;
+    const char *want = b->cfg->arg;
+    if (want != NULL ? strlen(want) != len || strncmp(name, want, len) != 0
+	: len == 2 && strncmp(name, "lo", 2) == 0)
+      continue;
+
+    const char *p = colon + 1;
+    rx += parse_u64(&p);
+    for (int i = 0; i < 7; i++)
+      parse_u64(&p);
+    tx += parse_u64(&p);
+  }
+
+  const long long now = monotonic_ns();
+  const double secs = (now - b->prev_ns) / 1e9;
+  /* a counter that went back (wrap, or an interface gone) has no rate this time */
+  const bool skip = b->prev_ns == 0 || rx < b->prev[0] || tx < b->prev[1];
+  const unsigned long long drx = rx - b->prev[0], dtx = tx - b->prev[1];
+  b->prev[0] = rx;
+  b->prev[1] = tx;
+  b->prev_ns = now;
+  if (skip || secs <= 0)
+    return -1;
+
+  char r[16], t[16];
+  human(r, sizeof(r), drx / secs);
+  human(t, sizeof(t), dtx / secs);
+  return snprintf(out, size, "%s%s/%s", b->cfg->label, r, t);
+}
+
+/* Finds the first battery below /sys/class/power_supply. */
+static bool find_battery(char *name, size_t size) {
+  DIR *d = opendir(POWER_SUPPLY);
+  struct dirent *e;
+  bool found = false;
+
+  if (d == NULL)
+    return false;
+  while (!found && (e = readdir(d)) != NULL) {
+    char path[PATH_MAX], type[32];
+    if (e->d_name[0] == '.')
+      continue;
+    snprintf(path, sizeof(path), POWER_SUPPLY "/%s/type", e->d_name);
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+      continue;
+    if (reread(fd, type, sizeof(type)) > 0 && strncmp(type, "Battery", 7) == 0) {
+      snprintf(name, size, "%s", e->d_name);
+      found = true;
+    }
+    close(fd);
+  }
+  closedir(d);
+  return found;
+}
+
+static int open_files(struct BuiltinState *b) {
+  char path[PATH_MAX], name[NAME_MAX + 1];
+
+  b->fd = b->fd2 = -1;
+  switch (b->cfg->type) {
+  case BuiltinCpu:
+    b->fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    break;
+  case BuiltinMem:
+    b->fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    break;
+  case BuiltinNet:
+    b->fd = open("/proc/net/dev", O_RDONLY | O_CLOEXEC);
+    break;
+  case BuiltinBattery:
+    if (b->cfg->arg != NULL)
+      snprintf(name, sizeof(name), "%s", b->cfg->arg);
+    else if (!find_battery(name, sizeof(name)))
+      return -1;
+    snprintf(path, sizeof(path), POWER_SUPPLY "/%s/capacity", name);
+    b->fd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), POWER_SUPPLY "/%s/status", name);
+    b->fd2 = open(path, O_RDONLY | O_CLOEXEC);
+    break;
+  }
+  return b->fd == -1 ? -1 : 0;
+}
+
+/* Refreshes one provider into its segment. */
+static void builtin_refresh(void *arg, time_t now) {
+  static int (*const update[])(struct BuiltinState *, char *, size_t) = {
+    [BuiltinCpu] = cpu_update,
+    [BuiltinMem] = mem_update,
+    [BuiltinBattery] = battery_update,
+    [BuiltinNet] = net_update,
+  };
+  struct BuiltinState *b = arg;
+  char out[64];
+
+  const long long start = stats_start();
+  int len = update[b->cfg->type](b, out, sizeof(out) - 1);
+  stats_record(StatRead, start);
+  stats_counters[StatReads]++;
+  if (len <= 0)
+    return;
+  if ((size_t) len > sizeof(out) - 2)
+    len = sizeof(out) - 2;
+  /* end like a status file so the renderer adds a separator */
+  out[len++] = '\n';
+  segment_set(b->segment, out, len);
+}
+
+/* Opens the configured providers; those whose files are missing are skipped. */
+int builtin_open(const struct Builtin *cfg, size_t n) {
+  if (n > MAX_BUILTINS) {
+    fprintf(stderr, "builtin: too many providers (%zu)\n", n);
+    return -1;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    struct BuiltinState *b = &builtins[nbuiltins];
+    b->cfg = &cfg[i];
+    if (open_files(b) == -1) {
+      fprintf(stderr, "builtin: [%s] unavailable\n", cfg[i].name);
+      continue;
+    }
+    if ((b->segment = segment_add(cfg[i].name, SegBuiltin)) == NULL) {
+      close(b->fd);
+      if (b->fd2 != -1)
+	close(b->fd2);
+      continue;
+    }
+
+    /* a quarter period of slack lets providers share wakeups with the clock */
+    const long long period = (cfg[i].interval > 0 ? cfg[i].interval : 1) * NSEC;
+    b->job = (struct Job) { .period = period, .slack = period / 4, .run = builtin_refresh, .arg = b };
+    builtin_refresh(b, time(NULL));
+    if (sched_add(&b->job) == -1) {
+      segment_remove(b->segment);
+      close(b->fd);
+      if (b->fd2 != -1)
+	close(b->fd2);
+      continue;
+    }
+    nbuiltins++;
+  }
+  return 0;
+}
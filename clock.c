@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "dwmstatus.h"
+
+#define MAX_FIELDS 64
+#define CLOCK_TEXT_MAX 200
+
+/*
+ * The clock line is compiled once into a template: the literal bytes
+ * are laid out in text and every conversion becomes a fixed-width field
+ * at a known offset. A tick then only rewrites the fields whose value
+ * changed, which is usually just the seconds.
+ */
+enum FieldType { Year, Year2, Month, Day, DaySpace, YearDay, Hour, Minute, Second,
+		 Weekday, MonthName };
+
+struct Field {
+  unsigned char clock;
+  unsigned char type;
+  unsigned short offset;
+  int last;
+};
+
+static const char weekdays[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char months[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+				    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+static const unsigned char widths[] = {
+  [Year] = 4, [Year2] = 2, [Month] = 2, [Day] = 2, [DaySpace] = 2, [YearDay] = 3,
+  [Hour] = 2, [Minute] = 2, [Second] = 2, [Weekday] = 3, [MonthName] = 3,
+};
+
+static const struct Clock *clocks;
+static struct Zone *zones[MAX_CLOCKS];
+static size_t nclocks;
+
+static char text[CLOCK_TEXT_MAX];
+static size_t text_len;
+static struct Field fields[MAX_FIELDS];
+static size_t nfields;
+static bool compiled;
+static bool coarse;
+static time_t last_now = -1;
+
+static bool add_literal(const char *s, size_t len) {
+  if (text_len + len >= sizeof(text))
+    return false;
+  memcpy(text + text_len, s, len);
+  text_len += len;
+  return true;
+}
+
+static bool add_field(size_t clock, enum FieldType type) {
+  if (nfields == MAX_FIELDS || text_len + widths[type] >= sizeof(text))
+    return false;
+  fields[nfields++] = (struct Field) { clock, type, text_len, -1 };
+  memset(text + text_len, ' ', widths[type]);
+  text_len += widths[type];
+  return true;
+}
+
+static bool add_fields(size_t clock, const enum FieldType *types, size_t n, const char *seps) {
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0 && !add_literal(&seps[i - 1], 1))
+      return false;
+    if (!add_field(clock, types[i]))
+      return false;
+  }
+  return true;
+}
+
+/* Returns false for formats using conversions without a fixed width. */
+static bool compile(void) {
+  static const enum FieldType hm[] = { Hour, Minute };
+  static const enum FieldType hms[] = { Hour, Minute, Second };
+  static const enum FieldType ymd[] = { Year, Month, Day };
+  static const enum FieldType mdy[] = { Month, Day, Year2 };
+
+  text_len = nfields = 0;
+  for (size_t c = 0; c < nclocks; c++) {
+    for (const char *f = clocks[c].format; *f != '\0'; f++) {
+      const char *lit = f;
+      while (*f != '\0' && *f != '%')
+	f++;
+      if (f > lit && !add_literal(lit, f - lit))
+	return false;
+      if (*f == '\0')
+	break;
+
+      bool ok;
+      switch (*++f) {
+      case 'Y': ok = add_field(c, Year); break;
+      case 'y': ok = add_field(c, Year2); break;
+      case 'm': ok = add_field(c, Month); break;
+      case 'd': ok = add_field(c, Day); break;
+      case 'e': ok = add_field(c, DaySpace); break;
+      case 'j': ok = add_field(c, YearDay); break;
+      case 'H': ok = add_field(c, Hour); break;
+      case 'M': ok = add_field(c, Minute); break;
+      case 'S': ok = add_field(c, Second); break;
+      case 'a': ok = add_field(c, Weekday); break;
+      case 'b':
+      case 'h': ok = add_field(c, MonthName); break;
+      case 'R': ok = add_fields(c, hm, LENGTH(hm), ":"); break;
+      case 'T': ok = add_fields(c, hms, LENGTH(hms), "::"); break;
+      case 'F': ok = add_fields(c, ymd, LENGTH(ymd), "--"); break;
+      case 'D': ok = add_fields(c, mdy, LENGTH(mdy), "//"); break;
+      case '%': ok = add_literal("%", 1); break;
+      case 'n': ok = add_literal("\n", 1); break;
+      case 't': ok = add_literal("\t", 1); break;
+      default: ok = false;
+      }
+      if (!ok)
+	return false;
+    }
+  }
+  text[text_len] = '\0';
+  return true;
+}
+
+static void put_digits(char *p, int value, int width, char pad) {
+  for (int i = width - 1; i >= 0; i--) {
+    p[i] = '0' + value % 10;
+    value /= 10;
+  }
+  for (int i = 0; i < width - 1 && p[i] == '0'; i++)
+    p[i] = pad;
+}
+
+/* Formats the whole line with strftime; the path for uncompilable formats. */
+static bool render_strftime(time_t now) {
+  char buf[CLOCK_TEXT_MAX];
+  char *p = buf;
+  struct tm tm;
+
+  for (size_t i = 0; i < nclocks; i++) {
+    tz_localtime(zones[i], now, &tm);
+    tm.tm_year += clocks[i].year_offset;
+    p += strftime(p, sizeof(buf) - (p - buf), clocks[i].format, &tm);
+  }
+
+  const size_t len = p - buf;
+  if (len == text_len && memcmp(buf, text, len) == 0)
+    return false;
+  memcpy(text, buf, len + 1);
+  text_len = len;
+  return true;
+}
+
+/* Resolves the zone of every configured clock and compiles their formats. */
+int clock_init(const struct Clock *c, size_t n) {
+  if (n > MAX_CLOCKS) {
+    fprintf(stderr, "clock_init: too many clocks (%zu)\n", n);
+    return -1;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if ((zones[i] = tz_get(c[i].zone)) == NULL)
+      return -1;
+  }
+  clocks = c;
+  nclocks = n;
+  last_now = -1;
+
+  if (!(compiled = compile())) {
+    fprintf(stderr, "clock_init: format not compilable, using strftime\n");
+    text_len = 0;
+  }
+  return 0;
+}
+
+/*
+ * Seconds between renders the formats need: 1 if they show seconds, else
+ * 60. In coarse mode it is always 60.
+ */
+int clock_period(void) {
+  if (coarse)
+    return 60;
+  if (!compiled)
+    return 1;
+  for (size_t i = 0; i < nfields; i++)
+    if (fields[i].type == Second)
+      return 1;
+  return 60;
+}
+
+/* Brings the clock line up to date for now; returns true if it changed. */
+bool clock_update(time_t now) {
+  struct tm tms[MAX_CLOCKS];
+  bool changed = false;
+
+  if (now == last_now)
+    return false;
+  last_now = now;
+
+  if (!compiled)
+    return render_strftime(now);
+
+  for (size_t i = 0; i < nclocks; i++) {
+    tz_localtime(zones[i], now, &tms[i]);
+    tms[i].tm_year += clocks[i].year_offset;
+  }
+
+  for (size_t i = 0; i < nfields; i++) {
+    struct Field *f = &fields[i];
+    const struct tm *tm = &tms[f->clock];
+    char *p = text + f->offset;
+    int v;
+
+    switch (f->type) {
+    case Year: v = (tm->tm_year + 1900) % 10000; break;
+    case Year2: v = (tm->tm_year + 1900) % 100; break;
+    case Month: v = tm->tm_mon + 1; break;
+    case Day:
+    case DaySpace: v = tm->tm_mday; break;
+    case YearDay: v = tm->tm_yday + 1; break;
+    case Hour: v = tm->tm_hour; break;
+    case Minute: v = tm->tm_min; break;
+    case Second: v = coarse ? -2 : tm->tm_sec; break;
+    case Weekday: v = tm->tm_wday; break;
+    default: v = tm->tm_mon; break;
+    }
+    if (v == f->last)
+      continue;
+    f->last = v;
+    changed = true;
+
+    if (v == -2) {
+      memcpy(p, "--", 2);
+      continue;
+    }
+    switch (f->type) {
+    case Weekday: memcpy(p, weekdays[v], 3); break;
+    case MonthName: memcpy(p, months[v], 3); break;
+    case DaySpace: put_digits(p, v, 2, ' '); break;
+    default: put_digits(p, v, widths[f->type], '0');
+    }
+  }
+  return changed;
+}
+
+/*
+ * Coarse mode is for ticking once a minute: seconds fields show "--"
+ * rather than a value that is wrong most of the time.
+ */
+void clock_set_coarse(bool on) {
+  coarse = on;
+  last_now = -1;
+}
+
+/* Forces the next clock_update to recompute every field, e.g. after a zone reload. */
+void clock_reset(void) {
+  last_now = -1;
+}
+
+const char *clock_text(size_t *len) {
+  *len = text_len;
+  return text;
+}
@@ -0,0 +1,302 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#include "dwmstatus.h"
+
+/*
+ * Command segments run "sh -c cmd" with posix_spawn and collect stdout
+ * from a non-blocking pipe in the event loop, so a slow command never
+ * holds up the clock. Exits are seen through a pidfd. A run that fails,
+ * prints nothing or outlives its timeout keeps the last good text; on
+ * timeout the whole process group is killed. At most max_running
+ * commands run at once and the rest wait their turn in a queue.
+ */
+
+#define MAX_COMMANDS 16
+
+extern char **environ;
+
+struct CommandState {
+  const struct Command *cfg;
+  struct Segment *segment;
+  struct Job job;
+  pid_t pid;
+  int out_fd, pid_fd;
+  int status;
+  bool busy, queued, timed_out;
+  long long kill_at;
+  char buf[STATUS_SIZE];
+  size_t len;
+};
+
+static struct CommandState commands[MAX_COMMANDS];
+static size_t ncommands;
+static struct CommandState *queue[MAX_COMMANDS];
+static size_t queue_head, queue_len;
+static int running, max_running;
+static int timer_fd = -1;
+
+static long long monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+/* Arms the timeout timer for the running command that is due first. */
+static void arm(void) {
+  long long when = 0;
+  for (size_t i = 0; i < ncommands; i++)
+    if (commands[i].pid > 0 && !commands[i].timed_out && (when == 0 || commands[i].kill_at < when))
+      when = commands[i].kill_at;
+
+  struct itimerspec its = { 0 };
+  its.it_value.tv_sec = when / NSEC;
+  its.it_value.tv_nsec = when % NSEC;
+  if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+    perror("command: timerfd_settime");
+}
+
+static void on_output(int fd, uint32_t events, void *arg);
+static void on_reaped(int fd, uint32_t events, void *arg);
+
+static int spawn(struct CommandState *c) {
+  int pipefd[2] = { -1, -1 };
+  posix_spawn_file_actions_t fa;
+  posix_spawnattr_t attr;
+  sigset_t none;
+  char *argv[] = { "sh", "-c", (char *) c->cfg->cmd, NULL };
+
+  if (pipe2(pipefd, O_CLOEXEC) == -1) {
+    perror("command: pipe2");
+    return -1;
+  }
+  fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+  posix_spawn_file_actions_init(&fa);
+  posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2(&fa, pipefd[1], STDOUT_FILENO);
+  /* the signals dwmstatus reads from its signalfd are blocked; undo that */
+  sigemptyset(&none);
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &none);
+  posix_spawnattr_setpgroup(&attr, 0);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+
+  const int err = posix_spawn(&c->pid, "/bin/sh", &fa, &attr, argv, environ);
+  posix_spawn_file_actions_destroy(&fa);
+  posix_spawnattr_destroy(&attr);
+  close(pipefd[1]);
+  if (err != 0) {
+    fprintf(stderr, "command: [%s] spawn failed (%d)\n", c->cfg->name, err);
+    goto fail;
+  }
+
+  c->pid_fd = pidfd_open(c->pid, 0);
+  if (c->pid_fd == -1 || loop_add(c->pid_fd, EPOLLIN, on_reaped, c) == -1) {
+    /* without a pidfd the child could not be reaped later */
+    perror("command: pidfd_open");
+    kill(-c->pid, SIGKILL);
+    waitpid(c->pid, NULL, 0);
+    if (c->pid_fd != -1)
+      close(c->pid_fd);
+    goto fail;
+  }
+  if (loop_add(pipefd[0], EPOLLIN, on_output, c) == -1) {
+    close(pipefd[0]);
+    pipefd[0] = -1;
+  }
+
+  c->out_fd = pipefd[0];
+  c->len = 0;
+  c->busy = true;
+  c->timed_out = false;
+  c->kill_at = monotonic_ns() + (long long) (c->cfg->timeout > 0 ? c->cfg->timeout : 10) * NSEC;
+  running++;
+  arm();
+  return 0;
+
+fail:
+  close(pipefd[0]);
+  c->pid = 0;
+  c->pid_fd = -1;
+  return -1;
+}
+
+/* Starts queued commands while there is room under the cap. */
+static void drain_queue(void) {
+  while (queue_len > 0 && running < max_running) {
+    struct CommandState *c = queue[queue_head];
+    queue_head = (queue_head + 1) % MAX_COMMANDS;
+    queue_len--;
+    c->queued = false;
+    spawn(c);
+  }
+}
+
+static void start(struct CommandState *c) {
+  /* the previous run has not finished: skip this one */
+  if (c->busy || c->queued)
+    return;
+  if (running < max_running) {
+    spawn(c);
+    return;
+  }
+  queue[(queue_head + queue_len) % MAX_COMMANDS] = c;
+  queue_len++;
+  c->queued = true;
+}
+
+static void on_job(void *arg, time_t now) {
+  start(arg);
+}
+
+static void close_output(struct CommandState *c) {
+  if (c->out_fd == -1)
+    return;
+  loop_del(c->out_fd);
+  close(c->out_fd);
+  c->out_fd = -1;
+}
+
+/* Both stdout is closed and the process is reaped: publish and clean up. */
+static void finish(struct CommandState *c) {
+  if (!c->busy || c->out_fd != -1 || c->pid > 0)
+    return;
+  c->busy = false;
+
+  if (c->timed_out)
+    fprintf(stderr, "command: [%s] timed out\n", c->cfg->name);
+  else if (!WIFEXITED(c->status) || WEXITSTATUS(c->status) != 0)
+    fprintf(stderr, "command: [%s] failed (%d)\n", c->cfg->name, c->status);
+  else if (c->len > 0) {
+    /* end like a status file so the renderer adds a separator */
+    if (c->buf[c->len - 1] != '\n') {
+      if (c->len == sizeof(c->buf))
+	c->len--;
+      c->buf[c->len++] = '\n';
+    }
+    segment_set(c->segment, c->buf, c->len);
+  }
+
+  running--;
+  drain_queue();
+}
+
+static void on_output(int fd, uint32_t events, void *arg) {
+  struct CommandState *c = arg;
+  char discard[512];
+  ssize_t r;
+
+  while (true) {
+    /* output beyond what a segment can hold is read and dropped */
+    if (c->len < sizeof(c->buf))
+      r = read(fd, c->buf + c->len, sizeof(c->buf) - c->len);
+    else
+      r = read(fd, discard, sizeof(discard));
+    if (r > 0) {
+      if (c->len < sizeof(c->buf))
+	c->len += r;
+      continue;
+    }
+    if (r == -1 && errno == EINTR)
+      continue;
+    if (r == -1 && errno == EAGAIN)
+      return;
+    break;
+  }
+  close_output(c);
+  finish(c);
+}
+
+static void on_reaped(int fd, uint32_t events, void *arg) {
+  struct CommandState *c = arg;
+
+  if (waitpid(c->pid, &c->status, WNOHANG) <= 0)
+    return;
+  loop_del(c->pid_fd);
+  close(c->pid_fd);
+  c->pid_fd = -1;
+  c->pid = 0;
+  /* a background grandchild may still hold the pipe open */
+  if (c->out_fd != -1) {
+    on_output(c->out_fd, EPOLLIN, c);
+    close_output(c);
+  }
+  finish(c);
+  arm();
+}
+
+static void on_timer(int fd, uint32_t events, void *arg) {
+  uint64_t expirations;
+  const long long now = monotonic_ns();
+
+  if (read(fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+    perror("command: timerfd");
+  for (size_t i = 0; i < ncommands; i++) {
+    struct CommandState *c = &commands[i];
+    if (c->pid > 0 && !c->timed_out && c->kill_at <= now) {
+      kill(-c->pid, SIGKILL);
+      c->timed_out = true;
+    }
+  }
+  arm();
+}
+
+/*
+ * Starts the configured command segments, each once now and then every
+ * interval seconds. At most max_run of them run at the same time.
+ */
+int command_open(const struct Command *cfg, size_t n, int max_run) {
+  if (n == 0)
+    return 0;
+  if (n > MAX_COMMANDS) {
+    fprintf(stderr, "command: too many commands (%zu)\n", n);
+    return -1;
+  }
+
+  max_running = max_run > 0 ? max_run : 1;
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd == -1 || loop_add(timer_fd, EPOLLIN, on_timer, NULL) == -1) {
+    perror("command: timerfd");
+    return -1;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    struct CommandState *c = &commands[ncommands];
+    c->cfg = &cfg[i];
+    c->out_fd = c->pid_fd = -1;
+    if ((c->segment = segment_add(cfg[i].name, SegCommand)) == NULL)
+      continue;
+    ncommands++;
+
+    start(c);
+    if (cfg[i].interval > 0) {
+      const long long period = (long long) cfg[i].interval * NSEC;
+      c->job = (struct Job) { .period = period, .slack = period / 4, .run = on_job, .arg = c };
+      sched_add(&c->job);
+    }
+  }
+  return 0;
+}
+
+/* Kills whatever is still running; used on exit. */
+void command_close(void) {
+  for (size_t i = 0; i < ncommands; i++) {
+    if (commands[i].pid > 0) {
+      kill(-commands[i].pid, SIGKILL);
+      waitpid(commands[i].pid, NULL, 0);
+    }
+  }
+}
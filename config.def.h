@@ -0,0 +1,114 @@
+/* See LICENSE file for copyright and license details. */
+
+/*
+ * Clocks are rendered left to right after the status segments. zone is a
+ * name below $TZDIR (or an absolute path, or a POSIX TZ string), "UTC",
+ * or NULL for the local zone. year_offset is added to the year before
+ * formatting, e.g. 543 for the Buddhist era. Without %S or %T in any
+ * format dwmstatus only wakes up once a minute for the clocks.
+ */
+static const struct Clock clocks[] = {
+  /* zone            format                           year_offset */
+  { "EST",           "EST: \x01\x03%R\x01\x01  ",     0 },
+  { "UTC",           "UTC: \x01\x04%R\x01\x01  ",     0 },
+  { "Asia/Tokyo",    "JST: \x01\x05%R\x01\x01  ",     0 },
+  { "Asia/Bangkok",  "%F (%a)  \x01\x06%T\x01\x01 ",  0 },
+  { "Asia/Bangkok",  " [%Y]",                         543 },
+};
+
+/*
+ * Limits for segments by name. width caps the characters a segment shows
+ * (0: no limit; color codes take none). When the segments do not fit in
+ * the bar, those with the lowest priority are cut first and dropped if
+ * nothing of them fits; unlisted segments have priority 0.
+ */
+static const struct SegmentRule segment_rules[] = {
+  /* segment   width  priority */
+  /* { "0vpn", 12,    1 }, */
+};
+
+/*
+ * Built-in providers. interval is in seconds; arg is the battery under
+ * /sys/class/power_supply (NULL: the first one found) or the network
+ * interface (NULL: all but lo). Network rates are shown as rx/tx per
+ * second.
+ */
+static const struct Builtin builtins[] = {
+  /* segment   type             interval  label    arg */
+  /* { "1cpu", BuiltinCpu,      2,        "CPU ",  NULL }, */
+  /* { "2mem", BuiltinMem,      5,        "MEM ",  NULL }, */
+  /* { "3bat", BuiltinBattery,  30,       "BAT ",  NULL }, */
+  /* { "4net", BuiltinNet,      2,        "NET ",  NULL }, */
+};
+
+/*
+ * Append-only files shown as their last lines. Only appended bytes are
+ * read; truncation and rotation are followed. Relative paths are below
+ * the status directory, and the segment is named after the file, so a
+ * log kept in the status directory is tailed instead of read whole.
+ */
+static const struct Tail tails[] = {
+  /* path                 lines */
+  /* { "messages.log",    1 }, */
+};
+
+/*
+ * Commands run with sh -c every interval seconds (0: once at startup);
+ * their standard output becomes the segment. A run is killed after
+ * timeout seconds (0: 10), and one that fails, times out or prints
+ * nothing leaves the previous text in place. At most max_commands run
+ * at the same time.
+ */
+static const struct Command commands[] = {
+  /* segment   command                                        interval  timeout */
+  /* { "0vpn", "ip -brief link show wg0 | cut -d' ' -f1",     10,       2 }, */
+  /* { "0git", "git -C ~/src/dwm status --short | wc -l",     30,       5 }, */
+};
+static const int max_commands = 4;
+
+/*
+ * Plugins loaded at startup, see dwmstatus-plugin.h. arg is passed to
+ * the plugin as is; a plugin that fails to load stops dwmstatus.
+ */
+static const struct Plugin plugins[] = {
+  /* path                                  arg */
+  /* { "/usr/local/lib/dwmstatus/up.so",   NULL }, */
+};
+
+/*
+ * Displays the status is published on; NULL is $DISPLAY. List one per
+ * seat, e.g. ":0" and ":1", or ":0.1" for a screen other than the
+ * default. output_backend is "xcb" or "xlib". With utf8_name the text is
+ * also set as _NET_WM_NAME.
+ *
+ * The "file" backend appends each line to output_path instead; NULL is
+ * stdout. A relative path starts at the status directory, where every
+ * file is read as a segment, so point it elsewhere. "null" discards the
+ * lines.
+ */
+static const char *const displays[] = { NULL };
+static const char *output_backend = "xcb";
+static const bool utf8_name = false;
+static const char *output_path = NULL;
+
+/*
+ * Power profiles. On battery the clocks tick once a minute, with seconds
+ * shown as "--", and the kernel may delay wakeups by battery_slack
+ * nanoseconds to batch them with others. While the screen is off (DPMS)
+ * or the screensaver is active, nothing periodic runs; only an X server
+ * older than DPMS 1.2, which sends no DPMS events, has a screen blanked
+ * by DPMS polled every 2 seconds.
+ */
+static const bool power_profiles = true;
+static const struct PowerConfig power_config = {
+  .ac_slack = 50000,          /* the kernel default */
+  .battery_slack = 50000000,
+};
+
+/*
+ * Producers push segments as "name\ntext" messages to this SOCK_SEQPACKET
+ * socket; an empty text removes the segment. NULL listens on
+ * $XDG_RUNTIME_DIR/dwmstatus.sock. Example:
+ *   printf 'vol\n50%%' | socat - UNIX-CONNECT:$XDG_RUNTIME_DIR/dwmstatus.sock,type=5
+ */
+static const char *socket_path = NULL;
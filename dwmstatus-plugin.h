@@ -0,0 +1,99 @@
+/*
+ * Plugin interface of dwmstatus.
+ *
+ * A plugin is a shared object listed in plugins[] of config.h. dwmstatus
+ * loads it with dlopen at startup, looks up the dwmstatus_plugin symbol
+ * and calls its open with a host table and the configured argument. The
+ * plugin then runs inside the event loop: it registers its fds and
+ * timers through the host, and writes its text straight into the buffer
+ * of a segment it claimed, so there is no process, file or socket
+ * between it and the status line. Callbacks must not block.
+ *
+ *   static const struct dwmstatus_host *host;
+ *   static struct dwmstatus_segment *seg;
+ *
+ *   static void tick(void *arg, time_t now) {
+ *     size_t size;
+ *     char *buf = host->segment_buffer(seg, &size);
+ *     host->segment_done(seg, snprintf(buf, size, "up %ld", (long) now));
+ *   }
+ *
+ *   static int open_up(const struct dwmstatus_host *h, const char *arg, void **state) {
+ *     host = h;
+ *     seg = host->segment("9up");
+ *     return seg != NULL && host->timer(60000000000LL, 0, tick, NULL) != NULL ? 0 : -1;
+ *   }
+ *
+ *   const struct dwmstatus_plugin dwmstatus_plugin = {
+ *     .abi = DWMSTATUS_PLUGIN_ABI, .name = "up", .open = open_up,
+ *   };
+ *
+ * Build it with cc -shared -fPIC -o up.so up.c.
+ */
+#ifndef DWMSTATUS_PLUGIN_H
+#define DWMSTATUS_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* bumped whenever a table below changes incompatibly */
+#define DWMSTATUS_PLUGIN_ABI 1
+#define DWMSTATUS_PLUGIN_SYMBOL "dwmstatus_plugin"
+
+struct dwmstatus_segment;
+struct dwmstatus_timer;
+
+/* What dwmstatus offers a plugin; valid until the plugin is closed. */
+struct dwmstatus_host {
+  uint32_t abi;
+  uint32_t size;		/* of this table; later versions only append */
+
+  /*
+   * Claims the segment called name and returns it, or NULL if the name is
+   * taken by another kind of source or the segment table is full.
+   */
+  struct dwmstatus_segment *(*segment)(const char *name);
+  /* The text buffer of s, *size bytes, to be written in place. */
+  char *(*segment_buffer)(struct dwmstatus_segment *s, size_t *size);
+  /*
+   * Marks the first len bytes of the buffer as the new text of s. Line
+   * breaks become separators; a last one is added if missing.
+   */
+  void (*segment_done)(struct dwmstatus_segment *s, size_t len);
+  /* Empties the text of s, which hides it until the next segment_done; s stays claimed. */
+  void (*segment_clear)(struct dwmstatus_segment *s);
+  /*
+   * Removes s from the status line and gives it up: s is invalid after
+   * this, and segment has to be called again to show text. To hide the
+   * segment and keep it, use segment_clear.
+   */
+  void (*segment_drop)(struct dwmstatus_segment *s);
+
+  /* Calls fn from the event loop when fd has any of events (EPOLLIN...). */
+  int (*watch)(int fd, uint32_t events, void (*fn)(int fd, uint32_t events, void *arg), void *arg);
+  int (*rewatch)(int fd, uint32_t events);
+  void (*unwatch)(int fd);
+
+  /*
+   * Calls fn every period nanoseconds on wall-clock multiples of the
+   * period, at most slack late. now is the wall-clock time.
+   */
+  struct dwmstatus_timer *(*timer)(long long period, long long slack,
+				   void (*fn)(void *arg, time_t now), void *arg);
+  void (*timer_stop)(struct dwmstatus_timer *t);
+};
+
+/* Exported by the plugin as const struct dwmstatus_plugin dwmstatus_plugin. */
+struct dwmstatus_plugin {
+  uint32_t abi;
+  const char *name;
+  /* Sets up the plugin; *state is handed to the other calls. 0 on success. */
+  int (*open)(const struct dwmstatus_host *host, const char *arg, void **state);
+  /* Optional: runs before every status line is rendered. */
+  void (*render)(void *state);
+  /* Optional: runs at exit; fds and timers are still registered. */
+  void (*close)(void *state);
+};
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * Shared-memory segment protocol of dwmstatus.
+ *
+ * A producer asks dwmstatus for the region over the push socket (see
+ * socket_path in config.def.h) and gets back a memfd holding an array of
+ * fixed-size slots plus an eventfd. It claims a slot by name and updates
+ * its text in place; each slot is a seqlock, so dwmstatus never copies a
+ * half-written text and neither side makes a system call per update.
+ * Writing to the eventfd is optional and only asks dwmstatus to look at
+ * the slots before its next tick. A slot whose producer exited without
+ * releasing it is freed, and its segment dropped, within a second.
+ *
+ *   struct dwmstatus_shm_client c;
+ *   if (dwmstatus_shm_attach(&c, NULL) == 0) {
+ *     struct dwmstatus_shm_slot *s = dwmstatus_shm_claim(&c, "vol");
+ *     dwmstatus_shm_update(&c, s, "50%", 3, true);
+ *   }
+ */
+#ifndef DWMSTATUS_SHM_H
+#define DWMSTATUS_SHM_H
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DWMSTATUS_SHM_MAGIC 0x31737764 /* "dws1" */
+#define DWMSTATUS_SHM_SLOTS 32
+#define DWMSTATUS_SHM_NAME_MAX 64
+#define DWMSTATUS_SHM_TEXT_MAX 248
+#define DWMSTATUS_SHM_REQUEST "\nshm"
+
+struct dwmstatus_shm_slot {
+  _Atomic uint32_t owner;	/* pid of the producer, 0 if free */
+  _Atomic uint32_t seq;		/* odd while the slot is being written */
+  uint32_t len;
+  char name[DWMSTATUS_SHM_NAME_MAX];
+  char text[DWMSTATUS_SHM_TEXT_MAX];
+} __attribute__((aligned(64)));
+
+struct dwmstatus_shm {
+  uint32_t magic;
+  uint32_t nslots;
+  _Atomic uint32_t generation;	/* bumped after every slot update */
+  struct dwmstatus_shm_slot slots[DWMSTATUS_SHM_SLOTS];
+};
+
+struct dwmstatus_shm_client {
+  struct dwmstatus_shm *shm;
+  int event_fd;
+};
+
+/* Whether the process owning a slot is gone; an owner that is no pid counts as gone. */
+static inline bool dwmstatus_shm_dead(uint32_t owner) {
+  return owner > INT_MAX || (kill((pid_t) owner, 0) == -1 && errno == ESRCH);
+}
+
+/* A producer killed mid-write leaves seq odd; writing from seq | 1 puts it right again. */
+static inline void dwmstatus_shm_write(struct dwmstatus_shm_slot *s, const char *name,
+				       const char *text, size_t len) {
+  const uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed) | 1;
+  atomic_store_explicit(&s->seq, seq, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  if (name != NULL)
+    strncpy(s->name, name, sizeof(s->name) - 1);
+  if (len > sizeof(s->text))
+    len = sizeof(s->text);
+  memcpy(s->text, text, len);
+  s->len = len;
+
+  atomic_store_explicit(&s->seq, seq + 1, memory_order_release);
+}
+
+/*
+ * Connects to dwmstatus and maps its slot region. socket_path NULL means
+ * $XDG_RUNTIME_DIR/dwmstatus.sock. Returns 0 on success.
+ */
+static inline int dwmstatus_shm_attach(struct dwmstatus_shm_client *c, const char *socket_path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  const char *dir = getenv("XDG_RUNTIME_DIR");
+  int fds[2] = { -1, -1 };
+
+  if (socket_path != NULL)
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+  else if (dir != NULL)
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/dwmstatus.sock", dir);
+  else
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/dwmstatus-%d.sock", (int) getuid());
+
+  const int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (sock == -1)
+    return -1;
+  if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1
+      || send(sock, DWMSTATUS_SHM_REQUEST, sizeof(DWMSTATUS_SHM_REQUEST) - 1, 0) == -1) {
+    close(sock);
+    return -1;
+  }
+
+  char reply[16];
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } control;
+  struct iovec iov = { reply, sizeof(reply) };
+  struct msghdr msg = {
+    .msg_iov = &iov, .msg_iovlen = 1,
+    .msg_control = control.buf, .msg_controllen = sizeof(control.buf),
+  };
+  const ssize_t r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  close(sock);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (r <= 0 || cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS
+      || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+    return -1;
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+  c->shm = mmap(NULL, sizeof(*c->shm), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+  close(fds[0]);
+  c->event_fd = fds[1];
+  if (c->shm == MAP_FAILED || c->shm->magic != DWMSTATUS_SHM_MAGIC) {
+    if (c->shm != MAP_FAILED)
+      munmap(c->shm, sizeof(*c->shm));
+    close(c->event_fd);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Returns the slot for segment name, taking over a slot of that name
+ * left by a producer that has exited, or else a free slot or one whose
+ * producer has exited. NULL if another running producer has the name
+ * or all slots are in use.
+ */
+static inline struct dwmstatus_shm_slot *dwmstatus_shm_claim(struct dwmstatus_shm_client *c,
+							     const char *name) {
+  const uint32_t pid = (uint32_t) getpid();
+  struct dwmstatus_shm *shm = c->shm;
+
+  for (uint32_t i = 0; i < shm->nslots; i++) {
+    struct dwmstatus_shm_slot *s = &shm->slots[i];
+    uint32_t owner = atomic_load(&s->owner);
+    if (owner == 0 || strncmp(s->name, name, sizeof(s->name)) != 0)
+      continue;
+    if (owner != pid && !dwmstatus_shm_dead(owner))
+      return NULL;
+    if (owner == pid || atomic_compare_exchange_strong(&s->owner, &owner, pid))
+      return s;
+    return NULL;
+  }
+  for (uint32_t i = 0; i < shm->nslots; i++) {
+    struct dwmstatus_shm_slot *s = &shm->slots[i];
+    uint32_t owner = atomic_load(&s->owner);
+    if (owner != 0 && !dwmstatus_shm_dead(owner))
+      continue;
+    if (atomic_compare_exchange_strong(&s->owner, &owner, pid)) {
+      dwmstatus_shm_write(s, name, "", 0);
+      return s;
+    }
+  }
+  return NULL;
+}
+
+/* Publishes text in slot s; wake asks dwmstatus to render before its next tick. */
+static inline void dwmstatus_shm_update(struct dwmstatus_shm_client *c, struct dwmstatus_shm_slot *s,
+					const char *text, size_t len, bool wake) {
+  dwmstatus_shm_write(s, NULL, text, len);
+  atomic_fetch_add_explicit(&c->shm->generation, 1, memory_order_release);
+  if (wake) {
+    const uint64_t one = 1;
+    if (write(c->event_fd, &one, sizeof(one)) == -1)
+      return;
+  }
+}
+
+/* Clears the segment of slot s and gives the slot back. */
+static inline void dwmstatus_shm_release(struct dwmstatus_shm_client *c, struct dwmstatus_shm_slot *s) {
+  dwmstatus_shm_update(c, s, "", 0, true);
+  atomic_store(&s->owner, 0);
+  atomic_fetch_add_explicit(&c->shm->generation, 1, memory_order_release);
+}
+
+static inline void dwmstatus_shm_detach(struct dwmstatus_shm_client *c) {
+  munmap(c->shm, sizeof(*c->shm));
+  close(c->event_fd);
+}
+
+#endif
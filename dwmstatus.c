@@ -1,135 +1,234 @@
-#include <X11/Xlib.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#include "dwmstatus.h"
+/* bench/ builds variants with another configuration */
+#ifdef CONFIG
+#include CONFIG
+#else
+#include "config.h"
+#endif
+
+static bool use_dir;
+static long bench_ticks;
+static bool clock_changed, first = true;
+static char statbuf[STATUS_SIZE], published[STATUS_SIZE];
+
+static void on_clock(void *arg, time_t now) {
+  clock_changed |= clock_update(now);
+}
+
+static void on_dir_poll(void *arg, time_t now) {
+  if (statusdir_update() == -1)
+    loop_quit(EXIT_FAILURE);
+}
 
-#define MAX_FILE 10
-#define SEPARATOR " / "
-#define SEP_LEN sizeof(SEPARATOR) - 1
+static struct Job clock_job = { .run = on_clock };
+static struct Job dir_job = { .period = NSEC, .slack = NSEC / 2, .run = on_dir_poll };
 
-int filter(const struct dirent *entry) {
-  return entry->d_type == DT_REG;
+static void on_power(const struct Power *p) {
+  clock_set_coarse(!p->on_ac);
+  sched_set_period(&clock_job, clock_period() * NSEC, 0);
+  clock_changed |= clock_update(time(NULL));
 }
 
-void main(int argc, char *argv[]) {
-  if (argc > 2) {
-    fprintf(stderr, "Too many arguments\n");
-    exit(1);
+static void on_statusdir(int fd, uint32_t events, void *arg) {
+  if (statusdir_update() == -1)
+    loop_quit(EXIT_FAILURE);
+}
+
+static void on_tz(int fd, uint32_t events, void *arg) {
+  if (tz_update()) {
+    clock_reset();
+    clock_changed |= clock_update(time(NULL));
   }
+}
 
-  if (argc == 2) {
-    if (chdir(argv[1]) == -1) {
-      fprintf(stderr, "chdir failed: [%s] (%d)\n", argv[1], errno);
-      exit(EXIT_FAILURE);
+static void on_signal(int fd, uint32_t events, void *arg) {
+  struct signalfd_siginfo si;
+
+  while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+    switch (si.ssi_signo) {
+    case SIGHUP:
+      fprintf(stderr, "SIGHUP: reloading\n");
+      if (use_dir && statusdir_reload() == -1)
+	loop_quit(EXIT_FAILURE);
+      tz_reload();
+      clock_reset();
+      clock_changed |= clock_update(time(NULL));
+      first = true;
+      break;
+    case SIGUSR1:
+      stats_dump();
+      break;
+    case SIGINT:
+    case SIGTERM:
+      loop_quit(EXIT_SUCCESS);
+      break;
     }
   }
+}
 
-  char *env_dsp = getenv("DISPLAY");
-  if (env_dsp == NULL) {
-    fprintf(stderr, "Envvar DISPLAY not defined\n");
+/* Runs after every wakeup; publishes the status line if a source changed it. */
+static void publish(void) {
+  /* slots written without an eventfd wakeup are picked up here */
+  shmseg_poll();
+  plugin_render();
+
+  stats_counters[StatTicks]++;
+  if (!clock_changed && !segments_dirty && !first)
+    return;
+  clock_changed = false;
+
+  const long long start = stats_start();
+  size_t dt_len;
+  const char *dt = clock_text(&dt_len);
+  char *p = statbuf;
+
+  p += segments_render(statbuf, sizeof(statbuf) - dt_len);
+  memcpy(p, dt, dt_len);
+  p[dt_len] = '\0';
+  stats_record(StatRender, start);
+  stats_counters[StatRenders]++;
+
+  /* skip the X round trip and dwm's redraw if nothing changed */
+  if (first || strcmp(statbuf, published) != 0) {
+    const long long out = stats_start();
+    output_set(statbuf, p + dt_len - statbuf);
+    stats_record(StatOutput, out);
+    stats_counters[StatPublishes]++;
+    strcpy(published, statbuf);
+    first = false;
+  } else {
+    stats_counters[StatSuppressed]++;
+  }
+  /* source-to-screen: from the first segment change to the X request */
+  stats_record(StatLatency, segments_changed);
+  segments_changed = 0;
+}
+
+/*
+ * Benchmark mode: runs ticks as fast as possible on a virtual clock that
+ * advances one clock period per tick. A tick is what a timer wakeup
+ * does: apply directory changes, update the clock and publish.
+ */
+static int run_ticks(long n) {
+  time_t now = time(NULL);
+
+  for (long i = 0; i < n; i++) {
+    now += clock_period();
+    if (use_dir && statusdir_update() == -1)
+      return EXIT_FAILURE;
+    clock_changed |= clock_update(now);
+    publish();
+  }
+  return EXIT_SUCCESS;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: dwmstatus [-r] [-o backend] [-b ticks] [dir]\n");
+  exit(EXIT_FAILURE);
+}
+
+void main(int argc, char *argv[]) {
+  const char *backend = output_backend;
+  bool watch = true;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:o:r")) != -1) {
+    switch (opt) {
+    case 'b':
+      if ((bench_ticks = atol(optarg)) <= 0)
+	usage();
+      break;
+    case 'o':
+      backend = optarg;
+      break;
+    case 'r':
+      watch = false;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (argc - optind > 1)
+    usage();
+  const char *dir = optind < argc ? argv[optind] : NULL;
+
+  if (loop_init() == -1 || sched_init() == -1)
     exit(EXIT_FAILURE);
+
+  if (dir != NULL) {
+    if (chdir(dir) == -1) {
+      fprintf(stderr, "chdir failed: [%s] (%d)\n", dir, errno);
+      exit(EXIT_FAILURE);
+    }
   }
 
-  Display* dsp = XOpenDisplay(env_dsp);
-  if (dsp == NULL) {
-    fprintf(stderr, "XOpenDisplay error\n");
+  segments_configure(segment_rules, LENGTH(segment_rules));
+
+  /* these claim their segment names before the directory is scanned */
+  if (tail_open(tails, LENGTH(tails)) == -1 || builtin_open(builtins, LENGTH(builtins)) == -1
+      || command_open(commands, LENGTH(commands), max_commands) == -1
+      || plugin_open(plugins, LENGTH(plugins)) == -1)
     exit(EXIT_FAILURE);
+
+  if (dir != NULL) {
+    const int dir_fd = statusdir_open(watch);
+    if (dir_fd == -2)
+      exit(EXIT_FAILURE);
+    use_dir = true;
+    if (dir_fd == -1 || loop_add(dir_fd, EPOLLIN, on_statusdir, NULL) == -1)
+      sched_add(&dir_job);
   }
 
-  Window win = DefaultRootWindow(dsp);
-
-  while (true) {
-    time_t now = time(NULL);
-    struct tm *tm;
-    char dtbuf[100], statbuf[300];
-    char *p = dtbuf;
-
-    setenv("TZ", ":EST", 1);
-    tm = localtime(&now);
-    p += strftime(p, sizeof(dtbuf) - (p - dtbuf), "EST: \x01\x03%R\x01\x01  ", tm);
-
-    tm = gmtime(&now);
-    p += strftime(p, sizeof(dtbuf) - (p - dtbuf), "UTC: \x01\x04%R\x01\x01  ", tm);
-
-    setenv("TZ", ":Asia/Tokyo", 1);
-    tm = localtime(&now);
-    p += strftime(p, sizeof(dtbuf) - (p - dtbuf), "JST: \x01\x05%R\x01\x01  ", tm);
-
-    setenv("TZ", ":Asia/Bangkok", 1);
-    tm = localtime(&now);
-    p += strftime(p, sizeof(dtbuf) - (p - dtbuf), "%F (%a)  \x01\x06%T\x01\x01 ", tm);
-
-    p += snprintf(p, sizeof(dtbuf) - (p - dtbuf), " [%d]", tm->tm_year + 1900 + 543);
-
-    if (argc == 1) {
-      p = dtbuf;
-    } else {
-      struct dirent **namelist;
-      const int n = scandir(".", &namelist, filter, alphasort);
-      if (n == -1) {
-	perror("scandir");
-	break;
-      }
-
-      const size_t dt_len = p - dtbuf + 1;
-      const char *statbuf_cap = statbuf + sizeof(statbuf) - dt_len;
-      p = statbuf;
-      for (int i = 0; i < n; i++) {
-	if (i < MAX_FILE && p < statbuf_cap) {
-	  const size_t remaining = statbuf_cap - p;
-
-	  FILE *fp = fopen(namelist[i]->d_name, "a+");
-	  if (fp == NULL) {
-	    fprintf(stderr, "fopen error: %s\n", argv[i]);
-	  } else {
-	    char readbuf[remaining];
-	    int r = fread(readbuf, 1, sizeof(readbuf), fp);
-	    fclose(fp);
-
-	    if (r < 1) continue;
-
-	    const char *rend = readbuf + r;
-	    char *rp = readbuf;
-	    while (rp < rend) {
-	      switch (*rp) {
-	      case '\n':
-	      case '\r':
-		if (statbuf_cap - p < SEP_LEN) {
-		  rp = readbuf + remaining;
-		  break;
-		}
-
-		memcpy(p, SEPARATOR, SEP_LEN);
-		p += SEP_LEN;
-		break;
-	      default:
-		*p = *rp;
-		p++;
-	      }
-	      rp++;
-	    }
-	  }
-	}
-
-	free(namelist[i]);
-      }
-      free(namelist);
-
-      strcpy(p, dtbuf);
-      p = statbuf;
-    }
+  const int tz_fd = tz_open();
+  if (tz_fd != -1)
+    loop_add(tz_fd, EPOLLIN, on_tz, NULL);
+  if (clock_init(clocks, LENGTH(clocks)) == -1)
+    exit(EXIT_FAILURE);
+  clock_changed = clock_update(time(NULL));
+  clock_job.period = clock_period() * NSEC;
+  if (sched_add(&clock_job) == -1)
+    exit(EXIT_FAILURE);
 
-    XStoreName(dsp, win, p);
-    XFlush(dsp);
+  if (output_open(displays, LENGTH(displays), output_path, backend, utf8_name) == -1)
+    exit(EXIT_FAILURE);
+  if (power_profiles && bench_ticks == 0
+      && power_open(&power_config, output_display(), on_power) == -1)
+    exit(EXIT_FAILURE);
 
-    sleep(1);
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGHUP);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGUSR1);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+  const int sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (sig_fd == -1 || loop_add(sig_fd, EPOLLIN, on_signal, NULL) == -1) {
+    perror("signalfd");
+    exit(EXIT_FAILURE);
   }
 
-  XCloseDisplay(dsp);
-  exit(EXIT_FAILURE);
+  /* a benchmark must not take over the socket of a running instance */
+  if (bench_ticks == 0 && push_open(socket_path) == 0)
+    shmseg_open();
+
+  publish();
+  const int status = bench_ticks > 0 ? run_ticks(bench_ticks) : loop_run(publish);
+
+  plugin_close();
+  command_close();
+  push_close();
+  output_close();
+  exit(status == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
 }
@@ -0,0 +1,201 @@
+#ifndef DWMSTATUS_H
+#define DWMSTATUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MAX_FILE 10
+#define MAX_CLOCKS 16
+#define MAX_SEGMENTS 64
+#define SEGMENT_NAME_MAX 64
+#define STATUS_SIZE 300
+#define NSEC 1000000000LL
+#define SEPARATOR " / "
+#define SEP_LEN (sizeof(SEPARATOR) - 1)
+
+enum SegmentOwner { SegDir, SegPush, SegShm, SegTail, SegBuiltin, SegCommand, SegPlugin };
+
+/* A named piece of the status line; segments are rendered in name order. */
+struct Segment {
+  char name[SEGMENT_NAME_MAX];
+  enum SegmentOwner owner;
+  int width;
+  int priority;
+  long long refreshed;
+  char text[STATUS_SIZE];
+  size_t len;
+};
+
+struct SegmentRule {
+  const char *name;
+  int width;
+  int priority;
+};
+
+struct Clock {
+  const char *zone;
+  const char *format;
+  int year_offset;
+};
+
+/* Periodic work run by sched.c; times are CLOCK_REALTIME nanoseconds. */
+struct Job {
+  long long period;
+  long long slack;
+  long long deadline;
+  size_t index;
+  void (*run)(void *arg, time_t now);
+  void *arg;
+};
+
+enum BuiltinType { BuiltinCpu, BuiltinMem, BuiltinBattery, BuiltinNet };
+
+struct Builtin {
+  const char *name;
+  enum BuiltinType type;
+  int interval;
+  const char *label;
+  const char *arg;
+};
+
+struct Command {
+  const char *name;
+  const char *cmd;
+  int interval;
+  int timeout;
+};
+
+struct Plugin {
+  const char *path;
+  const char *arg;
+};
+
+struct PowerConfig {
+  long long ac_slack;
+  long long battery_slack;
+};
+
+struct Power {
+  bool on_ac;
+  bool screen_off;
+};
+
+struct Tail {
+  const char *path;
+  int lines;
+};
+
+enum StatCounter { StatTicks, StatRenders, StatPublishes, StatSuppressed, StatReads, StatCounters };
+enum StatHistogram { StatRender, StatOutput, StatRead, StatLatency, StatHistograms };
+
+/* One read of reader_batch; res is the byte count or a negative errno. */
+struct ReadOp {
+  int fd;
+  void *buf;
+  size_t len;
+  long res;
+};
+
+struct Zone;
+
+#define LENGTH(X) (sizeof(X) / sizeof(X[0]))
+
+/* builtin.c */
+int builtin_open(const struct Builtin *cfg, size_t n);
+
+/* clock.c */
+int clock_init(const struct Clock *c, size_t n);
+int clock_period(void);
+bool clock_update(time_t now);
+void clock_set_coarse(bool on);
+void clock_reset(void);
+const char *clock_text(size_t *len);
+
+/* command.c */
+int command_open(const struct Command *cfg, size_t n, int max_run);
+void command_close(void);
+
+/* loop.c */
+int loop_init(void);
+int loop_add(int fd, uint32_t events, void (*handler)(int fd, uint32_t events, void *arg), void *arg);
+int loop_mod(int fd, uint32_t events);
+void loop_del(int fd);
+void loop_set_deadline(long long when, void (*fn)(void));
+void loop_quit(int status);
+int loop_run(void (*after_batch)(void));
+
+/* output.c */
+int output_open(const char *const *displays, size_t n, const char *path, const char *backend, bool utf8);
+void output_set(const char *text, size_t len);
+const char *output_display(void);
+void output_close(void);
+
+/* plugin.c */
+int plugin_open(const struct Plugin *cfg, size_t n);
+void plugin_render(void);
+void plugin_close(void);
+
+/* power.c */
+int power_open(const struct PowerConfig *c, const char *display, void (*fn)(const struct Power *p));
+
+/* push.c */
+int push_open(const char *path);
+void push_close(void);
+
+/* sched.c */
+int sched_init(void);
+int sched_add(struct Job *j);
+void sched_remove(struct Job *j);
+void sched_set_period(struct Job *j, long long period, long long slack);
+void sched_pause(bool pause);
+
+/* reader.c */
+int reader_init(void);
+void reader_batch(struct ReadOp *ops, size_t n);
+
+/* segment.c */
+extern bool segments_dirty;
+extern long long segments_changed;
+
+void segments_configure(const struct SegmentRule *r, size_t n);
+size_t segment_count(void);
+struct Segment *segment_at(size_t i);
+struct Segment *segment_get(const char *name);
+struct Segment *segment_add(const char *name, enum SegmentOwner owner);
+void segment_remove(struct Segment *s);
+bool segment_set(struct Segment *s, const char *buf, size_t len);
+size_t segments_render(char *buf, size_t cap);
+
+/* shm.c */
+int shmseg_open(void);
+int shmseg_send(int sock);
+void shmseg_poll(void);
+
+/* stats.c */
+extern bool stats_on;
+extern unsigned long long stats_counters[StatCounters];
+
+long long stats_clock(void);
+long long stats_start(void);
+void stats_record(enum StatHistogram h, long long start);
+size_t stats_format(char *buf, size_t size);
+void stats_dump(void);
+
+/* statusdir.c */
+int statusdir_open(bool watch);
+int statusdir_update(void);
+int statusdir_reload(void);
+
+/* tail.c */
+int tail_open(const struct Tail *cfg, size_t n);
+
+/* tz.c */
+int tz_open(void);
+struct Zone *tz_get(const char *name);
+void tz_localtime(struct Zone *z, time_t t, struct tm *tm);
+bool tz_update(void);
+void tz_reload(void);
+
+#endif
@@ -0,0 +1,367 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "imap.h"
+
+/* where in a response the parser is */
+enum Phase {PhaseTag, PhaseNumber, PhaseName, PhaseCode, PhaseCodeIn, PhaseText, PhaseArgs};
+/* what the parser is in the middle of */
+enum State {Between, Atom, Quoted, QuotedEscape, LiteralLength, LiteralClose, LiteralLf, LiteralData,
+   Text, LineEnd};
+
+static void start_response(struct ImapParser *p) {
+   p->phase = PhaseTag;
+   p->kind = ImapUntagged;
+   p->tag[0] = '\0';
+   p->name[0] = '\0';
+   p->has_number = false;
+   p->number = 0;
+   p->nargs = 0;
+   p->depth = 0;
+}
+
+/* Maps the ring twice in a row, so that ring[i] == ring[i + IMAP_RING_SIZE]. */
+int imap_init(struct ImapParser *p) {
+   char *base = MAP_FAILED;
+
+   p->ring = NULL;
+   const int fd = memfd_create("imap", MFD_CLOEXEC);
+   if (fd == -1) return -1;
+
+   if (ftruncate(fd, IMAP_RING_SIZE) == 0)
+      base = mmap(NULL, 2 * IMAP_RING_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (base != MAP_FAILED
+         && (mmap(base, IMAP_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+            || mmap(base + IMAP_RING_SIZE, IMAP_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+               fd, 0) == MAP_FAILED)) {
+      munmap(base, 2 * IMAP_RING_SIZE);
+      base = MAP_FAILED;
+   }
+   close(fd);
+   if (base == MAP_FAILED) return -1;
+
+   p->ring = base;
+   imap_reset(p);
+   return 0;
+}
+
+/* Drops everything buffered, e.g. for a new connection. */
+void imap_reset(struct ImapParser *p) {
+   p->head = p->release = p->scan = p->tail = 0;
+   p->state = Between;
+   p->returned = false;
+   p->ended = true;
+   start_response(p);
+}
+
+void imap_free(struct ImapParser *p) {
+   if (p->ring != NULL) munmap(p->ring, 2 * IMAP_RING_SIZE);
+   p->ring = NULL;
+}
+
+/* Free space at the end of the ring; received bytes go there. */
+char *imap_space(struct ImapParser *p, size_t *len) {
+   *len = IMAP_RING_SIZE - (p->tail - p->head);
+   return p->ring + p->tail % IMAP_RING_SIZE;
+}
+
+/* Adds len bytes written at imap_space. */
+void imap_fill(struct ImapParser *p, size_t len) {
+   p->tail += len;
+}
+
+static bool in_token(const struct ImapParser *p) {
+   return p->state == Atom || p->state == Quoted || p->state == QuotedEscape || p->state == LiteralData
+      || p->state == Text;
+}
+
+static void copy_head(const struct ImapParser *p, char *dst, size_t start, size_t len) {
+   if (len > IMAP_HEAD_MAX - 1) len = IMAP_HEAD_MAX - 1;
+   memcpy(dst, p->ring + start % IMAP_RING_SIZE, len);
+   dst[len] = '\0';
+}
+
+static bool is_status(const char *name) {
+   return strcasecmp(name, "OK") == 0 || strcasecmp(name, "NO") == 0 || strcasecmp(name, "BAD") == 0
+      || strcasecmp(name, "BYE") == 0 || strcasecmp(name, "PREAUTH") == 0;
+}
+
+/* Undoes the backslash escapes of a quoted string in place; returns its new length. */
+static size_t unescape(struct ImapParser *p, size_t start, size_t len) {
+   char *s = p->ring + start % IMAP_RING_SIZE;
+   if (memchr(s, '\\', len) == NULL) return len;
+
+   size_t n = 0;
+   for (size_t i = 0; i < len; i++) {
+      if (s[i] == '\\' && i + 1 < len) i++;
+      s[n++] = s[i];
+   }
+   return n;
+}
+
+/* Takes a finished token: into the head while in it, else as an argument. */
+static void token(struct ImapParser *p, enum ImapType type, size_t start, size_t len) {
+   const char *s = p->ring + start % IMAP_RING_SIZE;
+
+   switch (p->phase) {
+      case PhaseTag:
+         if (len == 1 && *s == '*') {
+            p->phase = PhaseNumber;
+         } else if (len == 1 && *s == '+') {
+            p->kind = ImapContinue;
+            p->phase = PhaseText;
+         } else {
+            copy_head(p, p->tag, start, len);
+            p->kind = ImapTagged;
+            p->phase = PhaseName;
+         }
+         return;
+      case PhaseNumber:
+         if (imap_number(&(struct ImapToken) {ImapAtom, s, len}, &p->number)) {
+            p->has_number = true;
+            p->phase = PhaseName;
+            return;
+         }
+         /* fall through */
+      case PhaseName:
+         copy_head(p, p->name, start, len);
+         p->phase = is_status(p->name) ? PhaseCode : PhaseArgs;
+         return;
+      default:
+         p->args[p->nargs].type = type;
+         p->args[p->nargs].p = s;
+         p->args[p->nargs].len = len;
+         p->nargs++;
+   }
+}
+
+/*
+ * Scans the buffered bytes. Returns 1 at the end of a response, 2 when
+ * the arguments are full, 0 when more bytes are needed and -1 on input
+ * that cannot be parsed.
+ */
+static int scan(struct ImapParser *p) {
+   while (p->scan < p->tail) {
+      if (p->nargs == IMAP_MAX_ARGS) return 2;
+
+      if (p->state == LiteralData) {
+         size_t n = p->tail - p->scan;
+         if (n > p->literal) n = p->literal;
+         p->scan += n;
+         p->literal -= n;
+         if (p->literal > 0) return 0;
+         token(p, ImapLiteral, p->tok_start, p->scan - p->tok_start);
+         p->state = Between;
+         continue;
+      }
+
+      const char ch = p->ring[p->scan % IMAP_RING_SIZE];
+      switch (p->state) {
+         case Between:
+            if (ch == ' ') break;
+            if (ch == '\r') {
+               p->state = LineEnd;
+               break;
+            }
+            if (ch == '\n') {
+               p->scan++;
+               return 1;
+            }
+
+            if (p->phase == PhaseCode) {
+               if (ch == '[') {
+                  token(p, ImapOpen, p->scan, 1);
+                  p->phase = PhaseCodeIn;
+                  p->depth = 1;
+                  break;
+               }
+               p->phase = PhaseText;
+            }
+            if (p->phase == PhaseText) {
+               p->tok_start = p->scan;
+               p->state = Text;
+               break;
+            }
+            if (p->phase == PhaseArgs || p->phase == PhaseCodeIn) {
+               const bool code = p->phase == PhaseCodeIn;
+               if (ch == '(' || (code && ch == '[')) {
+                  token(p, ImapOpen, p->scan, 1);
+                  p->depth += code && ch == '[';
+                  break;
+               }
+               if (ch == ')' || (code && ch == ']')) {
+                  token(p, ImapClose, p->scan, 1);
+                  if (code && ch == ']' && --p->depth == 0) p->phase = PhaseText;
+                  break;
+               }
+               if (ch == '"') {
+                  p->tok_start = p->scan + 1;
+                  p->state = Quoted;
+                  break;
+               }
+               if (ch == '{' && !code) {
+                  p->literal = 0;
+                  p->state = LiteralLength;
+                  break;
+               }
+            }
+            p->tok_start = p->scan;
+            p->state = Atom;
+            break;
+
+         case Atom:
+            if (ch == ' ' || ch == '\r' || ch == '\n' || ch == '(' || ch == ')' || ch == '"'
+                  || (p->phase == PhaseCodeIn && (ch == '[' || ch == ']'))) {
+               token(p, ImapAtom, p->tok_start, p->scan - p->tok_start);
+               p->state = Between;
+               /* the delimiter is looked at again */
+               continue;
+            }
+            break;
+
+         case Quoted:
+            if (ch == '\\') {
+               p->state = QuotedEscape;
+            } else if (ch == '"' || ch == '\r' || ch == '\n') {
+               /* an unterminated string ends with its line */
+               token(p, ImapQuoted, p->tok_start, unescape(p, p->tok_start, p->scan - p->tok_start));
+               p->state = Between;
+               if (ch != '"') continue;
+            }
+            break;
+         case QuotedEscape:
+            p->state = Quoted;
+            break;
+
+         case LiteralLength:
+            if (ch >= '0' && ch <= '9') {
+               p->literal = p->literal * 10 + (ch - '0');
+               if (p->literal > IMAP_RING_SIZE / 2) return -1;
+            } else if (ch == '}') {
+               p->state = LiteralClose;
+            } else if (ch != '+') {
+               return -1;
+            }
+            break;
+         case LiteralClose:
+            if (ch == '\r') {
+               p->state = LiteralLf;
+               break;
+            }
+            /* fall through */
+         case LiteralLf:
+            if (ch != '\n') return -1;
+            p->tok_start = p->scan + 1;
+            p->state = LiteralData;
+            break;
+
+         case Text:
+            if (ch == '\r' || ch == '\n') {
+               token(p, ImapText, p->tok_start, p->scan - p->tok_start);
+               p->state = Between;
+               continue;
+            }
+            break;
+
+         case LineEnd:
+            if (ch == '\n') p->scan++;
+            p->state = Between;
+            return 1;
+      }
+      p->scan++;
+   }
+   return 0;
+}
+
+static int give(struct ImapParser *p, struct ImapResponse *r, bool ended) {
+   r->kind = p->kind;
+   r->tag = p->tag;
+   r->has_number = p->has_number;
+   r->number = p->number;
+   r->name = p->name;
+   r->args = p->args;
+   r->nargs = p->nargs;
+   r->more = !ended;
+
+   p->ended = ended;
+   p->returned = true;
+   p->release = !ended && in_token(p) ? p->tok_start : p->scan;
+   return 1;
+}
+
+/*
+ * Parses the next response, or piece of one, into r. Returns 1 if there
+ * is one, 0 if more bytes are needed and -1 if the input is not IMAP or
+ * has a token that does not fit in the ring.
+ */
+int imap_next(struct ImapParser *p, struct ImapResponse *r) {
+   if (p->returned) {
+      p->head = p->release;
+      p->nargs = 0;
+      if (p->ended) start_response(p);
+      p->returned = false;
+   }
+
+   const int rc = scan(p);
+   if (rc < 0) return -1;
+   if (rc > 0) return give(p, r, rc == 1);
+   if (p->tail - p->head < IMAP_RING_SIZE) return 0;
+
+   /* the ring is full: return what is there, or drop the copied head */
+   if (p->nargs > 0) return give(p, r, false);
+   const size_t keep = in_token(p) ? p->tok_start : p->scan;
+   if (keep == p->head) return -1;
+   p->head = keep;
+   return 0;
+}
+
+/* Whether t is the atom atom, ignoring case as IMAP does. */
+bool imap_is(const struct ImapToken *t, const char *atom) {
+   return t->type == ImapAtom && strlen(atom) == t->len && strncasecmp(t->p, atom, t->len) == 0;
+}
+
+bool imap_number(const struct ImapToken *t, unsigned long *num) {
+   if (t->type != ImapAtom || t->len == 0 || t->len > 19) return false;
+
+   unsigned long n = 0;
+   for (size_t i = 0; i < t->len; i++) {
+      if (t->p[i] < '0' || t->p[i] > '9') return false;
+      n = n * 10 + (t->p[i] - '0');
+   }
+   *num = n;
+   return true;
+}
+
+/* Writes r back as a line for the log, cut to size. Returns the length. */
+size_t imap_format(const struct ImapResponse *r, char *buf, size_t size) {
+   size_t len = 0;
+#define OUT(...) do { \
+      const int n = snprintf(buf + len, size - len, __VA_ARGS__); \
+      if (n > 0) len = len + n < size ? len + n : size - 1; \
+   } while (0)
+
+   OUT("%s", r->kind == ImapTagged ? r->tag : r->kind == ImapUntagged ? "*" : "+");
+   if (r->has_number) OUT(" %lu", r->number);
+   if (r->name[0] != '\0') OUT(" %s", r->name);
+   for (size_t i = 0; i < r->nargs; i++) {
+      const struct ImapToken *t = &r->args[i];
+      switch (t->type) {
+         case ImapQuoted:
+            OUT(" \"%.*s\"", (int) t->len, t->p);
+            break;
+         case ImapLiteral:
+            OUT(" {%zu}", t->len);
+            break;
+         default:
+            OUT(" %.*s", (int) t->len, t->p);
+      }
+   }
+   if (r->more) OUT(" ...");
+#undef OUT
+   return len;
+}
@@ -0,0 +1,86 @@
+#ifndef IMAP_H
+#define IMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Incremental IMAP response parser over a fixed ring buffer.
+ *
+ * Received bytes go straight into the ring (imap_space, imap_fill), and
+ * imap_next returns one response at a time. Its tokens point into the
+ * ring, so nothing is copied but the tag and the response name; they
+ * stay valid until the next imap_next. The ring is mapped twice in a
+ * row, which keeps every token contiguous across the wrap. A quoted
+ * string comes without its quotes and with its backslash escapes
+ * undone, in place in the ring.
+ *
+ * A response with more arguments than IMAP_MAX_ARGS, or too long for
+ * the ring, is returned in pieces: every piece has the same head and
+ * all but the last have more set. A single token, literals included,
+ * has to fit in half the ring.
+ */
+
+#define IMAP_RING_SIZE (64 * 1024)
+#define IMAP_MAX_ARGS 64
+#define IMAP_HEAD_MAX 32
+
+enum ImapKind {ImapUntagged, ImapTagged, ImapContinue};
+
+/* Open and Close are '(' and ')', or '[' and ']' around a response code. */
+enum ImapType {ImapAtom, ImapQuoted, ImapLiteral, ImapOpen, ImapClose, ImapText};
+
+struct ImapToken {
+   enum ImapType type;
+   const char *p;
+   size_t len;
+};
+
+/*
+ * "* 12 FETCH (FLAGS (\Seen))" is untagged with number 12, name FETCH
+ * and the arguments Open, FLAGS, Open, \Seen, Close, Close. After a
+ * status (OK, NO, BAD, BYE, PREAUTH) come the response code, if any,
+ * and the human-readable rest of the line as one Text token.
+ */
+struct ImapResponse {
+   enum ImapKind kind;
+   const char *tag;
+   bool has_number;
+   unsigned long number;
+   const char *name;
+   const struct ImapToken *args;
+   size_t nargs;
+   bool more;
+};
+
+struct ImapParser {
+   char *ring;
+   /* absolute stream offsets: head <= release <= scan <= tail */
+   size_t head, release, scan, tail;
+   int phase, state;
+   size_t tok_start;
+   size_t literal;
+   int depth;
+   bool returned, ended;
+
+   enum ImapKind kind;
+   char tag[IMAP_HEAD_MAX];
+   char name[IMAP_HEAD_MAX];
+   bool has_number;
+   unsigned long number;
+   struct ImapToken args[IMAP_MAX_ARGS];
+   size_t nargs;
+};
+
+int imap_init(struct ImapParser*);
+void imap_reset(struct ImapParser*);
+void imap_free(struct ImapParser*);
+char *imap_space(struct ImapParser*, size_t *len);
+void imap_fill(struct ImapParser*, size_t len);
+int imap_next(struct ImapParser*, struct ImapResponse*);
+
+bool imap_is(const struct ImapToken*, const char *atom);
+bool imap_number(const struct ImapToken*, unsigned long *num);
+size_t imap_format(const struct ImapResponse*, char *buf, size_t size);
+
+#endif
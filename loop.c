@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "dwmstatus.h"
+
+#define MAX_WATCHES 64
+#define MAX_EVENTS 16
+
+struct Watch {
+  int fd;
+  void (*handler)(int fd, uint32_t events, void *arg);
+  void *arg;
+};
+
+static struct Watch watches[MAX_WATCHES];
+static int epoll_fd = -1;
+static bool running;
+static int exit_status;
+static long long deadline;
+static void (*on_deadline)(void);
+
+static long long realtime_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+int loop_init(void) {
+  for (size_t i = 0; i < MAX_WATCHES; i++)
+    watches[i].fd = -1;
+  if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    perror("epoll_create1");
+  return epoll_fd;
+}
+
+/* Calls handler(fd, revents, arg) from loop_run whenever fd is ready for events. */
+int loop_add(int fd, uint32_t events, void (*handler)(int, uint32_t, void *), void *arg) {
+  struct Watch *w = NULL;
+  for (size_t i = 0; i < MAX_WATCHES && w == NULL; i++)
+    if (watches[i].fd == -1)
+      w = &watches[i];
+  if (w == NULL) {
+    fprintf(stderr, "loop_add: too many watches\n");
+    return -1;
+  }
+
+  struct epoll_event ev = { .events = events, .data.ptr = w };
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    fprintf(stderr, "loop_add: epoll_ctl (%d)\n", errno);
+    return -1;
+  }
+  w->fd = fd;
+  w->handler = handler;
+  w->arg = arg;
+  return 0;
+}
+
+int loop_mod(int fd, uint32_t events) {
+  for (size_t i = 0; i < MAX_WATCHES; i++) {
+    if (watches[i].fd == fd) {
+      struct epoll_event ev = { .events = events, .data.ptr = &watches[i] };
+      return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+  }
+  return -1;
+}
+
+/* Stops watching fd; call before closing it. */
+void loop_del(int fd) {
+  for (size_t i = 0; i < MAX_WATCHES; i++) {
+    if (watches[i].fd == fd) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+      watches[i].fd = -1;
+      return;
+    }
+  }
+}
+
+/*
+ * Calls fn from loop_run once CLOCK_REALTIME reaches when (nanoseconds);
+ * 0 cancels. The wait is epoll's own timeout, so unlike a timerfd it is
+ * subject to the process' timer slack and the kernel may batch it with
+ * other wakeups.
+ */
+void loop_set_deadline(long long when, void (*fn)(void)) {
+  deadline = when;
+  on_deadline = fn;
+}
+
+/* Waits for events until the deadline, if any. */
+static int wait_events(struct epoll_event *events) {
+  if (deadline == 0)
+    return epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+  long long rel = deadline - realtime_ns();
+  if (rel < 0)
+    rel = 0;
+  const struct timespec ts = { rel / NSEC, rel % NSEC };
+  const int n = epoll_pwait2(epoll_fd, events, MAX_EVENTS, &ts, NULL);
+  if (n == -1 && errno == ENOSYS)
+    /* before Linux 5.11: milliseconds, rounded up so we do not wake early */
+    return epoll_wait(epoll_fd, events, MAX_EVENTS, (rel + 999999) / 1000000);
+  return n;
+}
+
+void loop_quit(int status) {
+  running = false;
+  exit_status = status;
+}
+
+/*
+ * Dispatches ready descriptors and the deadline until loop_quit is
+ * called. after_batch runs once per wakeup, after every handler of that
+ * wakeup, so changes from several sources are published together.
+ * Returns the status passed to loop_quit.
+ */
+int loop_run(void (*after_batch)(void)) {
+  struct epoll_event events[MAX_EVENTS];
+
+  running = true;
+  while (running) {
+    const int n = wait_events(events);
+    if (n == -1) {
+      if (errno == EINTR)
+	continue;
+      perror("epoll_wait");
+      return -1;
+    }
+
+    for (int i = 0; i < n && running; i++) {
+      struct Watch *w = events[i].data.ptr;
+      /* an earlier handler of this batch may have removed the watch */
+      if (w->fd != -1)
+	w->handler(w->fd, events[i].events, w->arg);
+    }
+    if (running && deadline != 0 && realtime_ns() >= deadline) {
+      deadline = 0;
+      on_deadline();
+    }
+    if (running && after_batch != NULL)
+      after_batch();
+  }
+  return exit_status;
+}
@@ -2,22 +2,30 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <strings.h>
 #include <tls.h>
 #include <netdb.h>
-#include <poll.h>
+#include <stdint.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
 
-#define MAX_ACCOUNTS 10
+#include "imap.h"
+#include "seqset.h"
+
+#define MAX_MAILBOXES 16
+#define MAILBOX_MAX 64
+#define MAX_EVENTS 64
 #define CRLF "\r\n"
-#define READ_BUFFER_SIZE 1024
-#define NEEDLE_BUFFER_SIZE 100
-#define UNSEENS_SIZE 128
+#define TAG_SIZE 16
+#define OUT_BUFFER_SIZE 4096
 #define RECONNECT_INTERVAL 30
 #define INACTIVITY_TIME_LIMIT 200
 #define IDLE_TIME_LIMIT 25 * 60
+#define STATUS_INTERVAL 60
+#define RETRY_INTERVAL 5
 
 struct Account {
    char *name;
@@ -25,6 +33,25 @@ struct Account {
    char *password;
    char *server;
    char *port;
+   // only the number of unseen messages is wanted
+   bool count_only;
+   // the first is selected, the others are watched with NOTIFY or STATUS
+   char *mailboxes[MAX_MAILBOXES];
+   // the same as IMAP quoted strings, for the commands
+   char *quoted[MAX_MAILBOXES];
+   size_t num_mailboxes;
+};
+
+enum FetchItem {FetchNone, FetchUid, FetchModseq, FetchFlags, FetchOther};
+
+// a FETCH response parsed so far; a long one comes in pieces (see imap.h)
+struct Fetch {
+   int depth;
+   enum FetchItem item;
+   unsigned long uid;
+   unsigned long modseq;
+   bool flags;
+   bool seen;
 };
 
 struct Client {
@@ -33,54 +60,135 @@ struct Client {
    struct addrinfo *addrinfo;
    struct tls *tls;
    int socket;
+   int epoll;
 
    enum Phase {Disconnected, Connected} phase;
-   short events;
-   int (*handler)(struct Client*, char *line);
+   // registered with epoll while Connected
+   uint32_t events;
+   int (*handler)(struct Client*, const struct ImapResponse*);
 
-   char *read_buffer;
-   char *rb_cur_pos;
-   size_t rb_size;
-   char needle_buffer[NEEDLE_BUFFER_SIZE];
-   size_t nb_size;
-   size_t needle_length;
+   struct ImapParser parser;
+   char tag[TAG_SIZE];
+
+   // commands not yet taken by TLS: out[out_pos..out_len)
+   char out[OUT_BUFFER_SIZE];
+   size_t out_pos;
+   size_t out_len;
+   // what TLS waits for to go on reading and writing; either may be both while renegotiating
+   uint32_t read_wants;
+   uint32_t write_wants;
 
    size_t conn_cnt;
    time_t timer1;
    time_t timer2;
+   // when the main loop looks at it next, ready or not; its place in the heap ordered by that
+   time_t deadline;
+   size_t heap_index;
+   int last_cnt;
    size_t seq;
    size_t exists;
-   int us_cnt;
-   int *unseens;
-   size_t us_size;
+   // unseen sequence numbers, or unseen UIDs while QRESYNC is on; those stay valid across connections
+   struct SeqSet unseens;
+   struct UidSet uids;
+
+   // Cap* bits from the CAPABILITY seen after LOGIN, once caps_fresh
+   unsigned caps;
+   bool caps_fresh;
+   // QRESYNC enabled on this connection; the mailbox keeps no mod-sequences
+   bool qresync;
+   bool nomodseq;
+   bool uid_mode;
+   // unseens has every change up to modseq of the mailbox under uidvalidity, unless full_sync
+   unsigned long uidvalidity;
+   unsigned long modseq;
+   bool full_sync;
+   // highest mod-sequence reported since the SELECT; becomes modseq once a sync completes
+   unsigned long seen_modseq;
+   // inside the "(MODSEQ n)" that ends a SEARCH result
+   bool search_modseq;
+
+   // the server counts (ESEARCH) instead of listing
+   bool counting;
+   size_t count;
+   // the selected mailbox changed in a way only a search tells: new mail, or any change when counting
+   bool recount;
+   struct Fetch fetch;
+
+   // unseen in the other mailboxes, by index in account->mailboxes; stale ones want a STATUS
+   size_t folder_unseen[MAX_MAILBOXES];
+   bool folder_stale[MAX_MAILBOXES];
+   time_t status_time;
+   // NOTIFY asked for on this connection, and taken
+   bool notify_asked;
+   bool notify;
+};
+
+// clients by deadline, the earliest first
+struct Heap {
+   struct Client **items;
+   size_t len;
 };
 
+enum Capability {CapCondstore = 1 << 0, CapQresync = 1 << 1, CapEsearch = 1 << 2, CapNotify = 1 << 3};
+
 int setup_config(struct tls_config *cfg);
-size_t load_accounts(struct Account as[]);
-void client_init(struct Client*, struct tls_config*, struct Account*);
+struct Account *load_accounts(size_t *num_accounts);
+char *quote_mailbox(const char*);
+void client_init(struct Client*, struct tls_config*, struct Account*, int epoll);
+void client_ready(struct Client*, uint32_t revents);
+void client_timer(struct Client*, time_t);
+time_t client_deadline(struct Client*);
+int client_unseen(struct Client*);
 int client_connect(struct Client*);
 int client_starttls(struct Client*);
 void client_disconnect(struct Client*);
 ssize_t client_read(struct Client*);
+int client_dispatch(struct Client*);
 ssize_t client_write(struct Client*, const void *buf, size_t len, char *log);
-int client_login(struct Client*, char*);
-int client_login_sent(struct Client*, char*);
-int client_select_sent(struct Client*, char*);
+int client_flush(struct Client*);
+void client_events(struct Client*);
+int client_done(struct Client*, const struct ImapResponse*);
+void client_update(struct Client*, const struct ImapResponse*);
+void client_capabilities(struct Client*, const struct ImapToken*, size_t);
+void client_fetch(struct Client*, const struct ImapResponse*);
+int client_login(struct Client*, const struct ImapResponse*);
+int client_login_sent(struct Client*, const struct ImapResponse*);
+int client_capability_sent(struct Client*, const struct ImapResponse*);
+void client_enable(struct Client*);
+int client_enable_sent(struct Client*, const struct ImapResponse*);
+void client_select(struct Client*);
+int client_select_sent(struct Client*, const struct ImapResponse*);
 void client_search(struct Client*);
-int client_search_sent(struct Client*, char*);
-int client_idle_sent(struct Client*, char*);
+int client_search_sent(struct Client*, const struct ImapResponse*);
+void client_status(struct Client*);
+int client_status_sent(struct Client*, const struct ImapResponse*);
+void client_status_check_interval(struct Client*, time_t);
+void client_notify(struct Client*);
+int client_notify_sent(struct Client*, const struct ImapResponse*);
+void client_idle(struct Client*);
+int client_idle_sent(struct Client*, const struct ImapResponse*);
 void client_idle_check_time_limit(struct Client*, time_t);
 void client_idle_done(struct Client*);
-int client_idle_done_sent1(struct Client*, char*);
-int client_idle_done_sent2(struct Client*, char*);
+int client_idle_done_sent1(struct Client*, const struct ImapResponse*);
+int client_idle_done_sent2(struct Client*, const struct ImapResponse*);
+int client_idle_done_sent3(struct Client*, const struct ImapResponse*);
 void client_logout(struct Client*);
-int client_logout_sent(struct Client*, char*);
-
-void add_unseens(struct Client*, int);
-void remove_unseens(struct Client*, int);
-void decrement_unseens(struct Client*, int);
+int client_logout_sent(struct Client*, const struct ImapResponse*);
+
+size_t account_mailbox(struct Account*, const struct ImapToken*);
+int add_unseens(struct Client*, unsigned long);
+int remove_unseens(struct Client*, unsigned long lo, unsigned long hi);
+void clear_unseens(struct Client*);
+size_t count_unseens(struct Client*);
+unsigned long next_unseen(struct Client*, unsigned long after);
+void lost_unseens(struct Client*, unsigned long);
+int vanish_unseens(struct Client*, const struct ImapToken*, size_t *n);
 void print_unseens(struct Client*);
 
+void heap_fix(struct Heap*, size_t i);
+void heap_schedule(struct Heap*, struct Client*, time_t now, time_t retry);
+int write_status(const char *file, struct Client*, size_t);
+
 void main_loop(const char *, struct tls_config*);
 
 #define log_app(fmt,...) fprintf(stdout, fmt "\n", __VA_ARGS__);
@@ -119,173 +227,247 @@ int main(int argc, char *argv[]) {
 }
 
 void main_loop(const char *file, struct tls_config *cfg) {
-   struct Account accounts[MAX_ACCOUNTS];
-   const size_t num_accounts = load_accounts(accounts);
+   size_t num_accounts;
+   struct Account *accounts = load_accounts(&num_accounts);
+   if (num_accounts == 0) {
+      err_app_("No accounts on stdin.");
+      free(accounts);
+      return;
+   }
 
-   struct Client clients[num_accounts];
-   struct pollfd pfds[num_accounts];
-   int last_cnts[num_accounts];
+   const int epoll = epoll_create1(EPOLL_CLOEXEC);
+   struct Client *clients = calloc(num_accounts, sizeof(struct Client));
+   struct Heap heap = { calloc(num_accounts, sizeof(struct Client*)), num_accounts };
+   if (epoll == -1 || clients == NULL || heap.items == NULL) {
+      err_app_("main_loop: out of resources");
+      exit(1);
+   }
 
-   for (int i = 0; i < num_accounts; i++) {
-      client_init(&clients[i], cfg, &accounts[i]);
-      last_cnts[i] = -1;
+   // all due at once: a valid heap as it is
+   for (size_t i = 0; i < num_accounts; i++) {
+      struct Client *c = &clients[i];
+      client_init(c, cfg, &accounts[i], epoll);
+      c->deadline = client_deadline(c);
+      c->heap_index = i;
+      heap.items[i] = c;
    }
 
+   struct epoll_event events[MAX_EVENTS];
    while (true) {
       time_t now = time(NULL);
-      for (int i = 0; i < num_accounts; i++) {
-         struct Client *c = &clients[i];
-         struct Account *a = &accounts[i];
-         struct pollfd *p = &pfds[i];
-
-         time_t elapsed = now - c->timer1;
-         switch (c->phase) {
-            case Disconnected:
-               if (elapsed > RECONNECT_INTERVAL) {
-                  client_connect(c);
-               } else if (now - c->timer2 > 10) {
-                  log_account(a, "Reconnect Timer: %d sec", elapsed);
-                  c->timer2 = now;
-               }
-               break;
-            case Connected:
-               // check inactivity
-               if (elapsed > INACTIVITY_TIME_LIMIT) {
-                  log_account(a, "Inactivity: %d sec", elapsed);
-                  if (c->handler == client_idle_sent) {
-                     client_idle_done(c);
-                     c->handler = client_idle_done_sent2;
-                  } else if (c->handler != client_logout_sent) {
-                     client_logout(c);
-                  } else {
-                     client_disconnect(c);
-                  }
-               }
-               break;
-         }
+      const time_t due = heap.items[0]->deadline;
+      const int timeout = due <= now ? 0 : (due - now) * 1000;
 
-         p->fd = (c->events == 0 ? -1: c->socket);
-         p->events = c->events | POLLHUP;
+      const int n = epoll_wait(epoll, events, MAX_EVENTS, timeout);
+      if (n == -1 && errno != EINTR) {
+         err_app("epoll_wait: %s", strerror(errno));
+         break;
       }
 
-      const int poll_rc = poll(pfds, num_accounts, 5000);
-      if (poll_rc == 0) continue;
+      now = time(NULL);
+      bool changed = false;
 
-      struct tm *tp = localtime(&now);
-      char ts[20];
-      strftime(ts, sizeof(ts), "%F %T", tp);
-      log_app("%s | poll() => %d", ts, poll_rc);
+      if (n > 0) {
+         struct tm *tp = localtime(&now);
+         char ts[20];
+         strftime(ts, sizeof(ts), "%F %T", tp);
+         log_app("%s | epoll_wait() => %d", ts, n);
+      }
+      for (int i = 0; i < n; i++) {
+         struct Client *c = events[i].data.ptr;
+         client_ready(c, events[i].events);
+         heap_schedule(&heap, c, now, c->deadline > now ? c->deadline : now);
+         changed = changed || client_unseen(c) != c->last_cnt;
+      }
 
-      for (int i = 0; i < num_accounts; i++) {
-         struct Client *c = &clients[i];
-         struct Account *a = &accounts[i];
-         struct pollfd *p = &pfds[i];
-         if (p->revents == 0) continue;
+      while (heap.items[0]->deadline <= now) {
+         struct Client *c = heap.items[0];
+         client_timer(c, now);
+         heap_schedule(&heap, c, now, now + RETRY_INTERVAL);
+         changed = changed || client_unseen(c) != c->last_cnt;
+      }
 
-         char buf[200];
-         log_account(a, "socket=%d, events=%d, conn_cnt=%d, seq=%d, exists=%d", c->socket, c->events, c->conn_cnt, c->seq, c->exists);
-         log_account(a, "pfd: fd=%d, events=%d, revents=%d", p->fd, p->events ^ POLLHUP, p->revents);
-         if (p->revents == 0) continue;
+      if (changed && write_status(file, clients, num_accounts) == -1) {
+         break;
+      }
+   }
 
-         if (p->revents & (POLLERR | POLLNVAL)) {
-            err_account_(a, "POLLERR or POLLNVAL");
-            exit(1);
-            continue;
-         }
-         if (p->revents & POLLHUP) {
-            err_account_(a, "POLLHUP");
-            client_disconnect(c);
-            continue;
-         }
+   for (size_t i = 0; i < num_accounts; i++) {
+      struct Client *c = &clients[i];
+      if (c->phase == Connected) client_disconnect(c);
 
-         int rc;
-         switch (c->phase) {
-            case Disconnected:
-               break;
-            case Connected:
-               if ((p->revents & POLLIN) != 0) {
-                  int (*hdlr)(struct Client*, char*) = c->handler;
-                  if (hdlr == NULL) {
-                     client_disconnect(c);
-                     continue;
-                  }
-                  if (hdlr == client_idle_sent)
-                     print_unseens(c);
-
-                  rc = client_read(c);
-                  if (rc == 0) {
-                     client_disconnect(c);
-                     continue;
-                  } else if (rc < 0) {
-                     continue;
-                  }
-
-                  char *p1, *p2;
-                  p1 = c->read_buffer;
-                  while ((p2 = strstr(p1, CRLF)) != NULL) {
-                     *p2 = '\0';
-                     log_account(a, "\"%s\"", p1);
-
-                     hdlr(c, p1);
-
-                     p1 = p2 + 2;
-                     if (p1 > c->read_buffer + c->rb_size) break;
-                  }
-
-                  if (hdlr == client_idle_sent)
-                     client_idle_check_time_limit(c, now);
-               }
-               if (c->handler == NULL && (p->revents & POLLOUT) != 0) {
-                  client_starttls(c);
-                  c->needle_length = snprintf(c->needle_buffer, c->nb_size, "* OK");
-                  c->handler = client_login;
-               }
-
-               break;
-         }
+      free(accounts[i].name);
+      for (size_t k = 0; k < accounts[i].num_mailboxes; k++) {
+         free(accounts[i].quoted[k]);
       }
+      imap_free(&c->parser);
+      seqset_free(&c->unseens);
+      uidset_free(&c->uids);
+   }
+   free(heap.items);
+   free(clients);
+   free(accounts);
+   close(epoll);
+}
 
-      bool changed = false;
-      char buf[200];
-      char *p = buf;
-      for (int i = 0; i < num_accounts; i++) {
-         struct Client *c = &clients[i];
-         struct Account *a = &accounts[i];
+// what the socket of c is ready for, from epoll
+void client_ready(struct Client *c, uint32_t revents) {
+   struct Account *a = c->account;
 
-         if (c->us_cnt != last_cnts[i]) changed = true;
-         last_cnts[i] = c->us_cnt;
+   log_account(a, "socket=%d, events=%d, conn_cnt=%d, seq=%d, exists=%d", c->socket, c->events, c->conn_cnt, c->seq, c->exists);
+   log_account(a, "revents=%d", revents);
+   if (c->phase != Connected) {
+      return;
+   }
 
-         if (c->us_cnt > 0) {
-            p+= snprintf(p, sizeof(buf) - (p - buf), "(%s: %d) ", a->name, c->us_cnt);
-         }
+   // a refused connect ends here too
+   if ((revents & (EPOLLERR | EPOLLHUP)) != 0) {
+      err_account(a, "%s", (revents & EPOLLERR) != 0 ? "EPOLLERR" : "EPOLLHUP");
+      client_disconnect(c);
+      return;
+   }
+
+   if (c->handler == NULL) {
+      if ((revents & EPOLLIN) != 0) {
+         client_disconnect(c);
+      } else if ((revents & EPOLLOUT) != 0) {
+         client_starttls(c);
+         c->handler = client_login;
       }
-      if (p > buf) {
-         p+= snprintf(p, sizeof(buf) - (p - buf), "| ");
-      } else {
-         *p = '\0';
+      return;
+   }
+
+   if (c->out_pos < c->out_len && (revents & c->write_wants) != 0) {
+      if (client_flush(c) == -1) {
+         client_disconnect(c);
+         return;
       }
+   }
 
-      if (changed) {
-         FILE *fd = fopen(file, "w");
-         if (fd == NULL) {
-            err_app("File could not be opened: %s", file);
-            break;
+   if ((revents & c->read_wants) != 0) {
+      if (c->handler == client_idle_sent)
+         print_unseens(c);
+
+      // read until TLS runs dry; responses may span reads
+      ssize_t rc;
+      while ((rc = client_read(c)) > 0 && client_dispatch(c) == 0)
+         ;
+      if (c->phase == Connected && (rc == 0 || rc == -1)) {
+         client_disconnect(c);
+      }
+   }
+}
+
+// the reconnect and inactivity timers, and those of IDLE
+void client_timer(struct Client *c, time_t now) {
+   struct Account *a = c->account;
+
+   time_t elapsed = now - c->timer1;
+   switch (c->phase) {
+      case Disconnected:
+         if (elapsed > RECONNECT_INTERVAL) {
+            client_connect(c);
+         }
+         break;
+      case Connected:
+         if (c->handler == client_idle_sent) {
+            client_status_check_interval(c, now);
          }
-         if (p != buf) fprintf(fd, buf);
-         fclose(fd);
+         if (c->handler == client_idle_sent) {
+            client_idle_check_time_limit(c, now);
+         }
+
+         // check inactivity
+         if (elapsed > INACTIVITY_TIME_LIMIT) {
+            log_account(a, "Inactivity: %d sec", elapsed);
+            if (c->handler == client_idle_sent) {
+               client_idle_done(c);
+               c->handler = client_idle_done_sent2;
+            } else if (c->handler != client_logout_sent) {
+               client_logout(c);
+            } else {
+               client_disconnect(c);
+            }
+         }
+         break;
+   }
+}
+
+// the earliest time one of the timers of c fires
+time_t client_deadline(struct Client *c) {
+   struct Account *a = c->account;
+
+   if (c->phase == Disconnected) {
+      return c->timer1 + RECONNECT_INTERVAL + 1;
+   }
+
+   time_t t = c->timer1 + INACTIVITY_TIME_LIMIT + 1;
+   if (c->handler == client_idle_sent) {
+      if (c->timer2 + IDLE_TIME_LIMIT + 1 < t) t = c->timer2 + IDLE_TIME_LIMIT + 1;
+      if (a->num_mailboxes > 1 && !c->notify && c->status_time + STATUS_INTERVAL + 1 < t) {
+         t = c->status_time + STATUS_INTERVAL + 1;
       }
    }
+   return t;
+}
 
-   for (int i = 0; i < num_accounts; i++) {
-      struct Client *c = &clients[i];
-      client_disconnect(c);
+// unseen in all mailboxes of the account
+int client_unseen(struct Client *c) {
+   int count = c->counting ? c->count : count_unseens(c);
+   for (size_t k = 1; k < c->account->num_mailboxes; k++) count += c->folder_unseen[k];
+   return count;
+}
 
-      free(accounts[i].name);
-      if (clients[i].read_buffer != NULL)
-         free(clients[i].read_buffer);
-      if (clients[i].unseens != NULL)
-         free(clients[i].unseens);
+// moves items[i] up or down to where its deadline belongs
+void heap_fix(struct Heap *h, size_t i) {
+   struct Client *c = h->items[i];
+
+   while (i > 0 && h->items[(i - 1) / 2]->deadline > c->deadline) {
+      h->items[i] = h->items[(i - 1) / 2];
+      h->items[i]->heap_index = i;
+      i = (i - 1) / 2;
+   }
+   while (2 * i + 1 < h->len) {
+      size_t child = 2 * i + 1;
+      if (child + 1 < h->len && h->items[child + 1]->deadline < h->items[child]->deadline) child++;
+      if (h->items[child]->deadline >= c->deadline) break;
+      h->items[i] = h->items[child];
+      h->items[i]->heap_index = i;
+      i = child;
    }
+   h->items[i] = c;
+   c->heap_index = i;
+}
+
+// a deadline still past after its timer ran, e.g. a failing connect or a silent server
+// on the way to LOGOUT, is retried at retry instead of on every wakeup
+void heap_schedule(struct Heap *h, struct Client *c, time_t now, time_t retry) {
+   const time_t deadline = client_deadline(c);
+   c->deadline = deadline > now ? deadline : retry;
+   heap_fix(h, c->heap_index);
+}
+
+// rewrites the status file with every account that has unseen mail
+int write_status(const char *file, struct Client *clients, size_t n) {
+   FILE *fd = fopen(file, "w");
+   if (fd == NULL) {
+      err_app("File could not be opened: %s", file);
+      return -1;
+   }
+
+   bool any = false;
+   for (size_t i = 0; i < n; i++) {
+      struct Client *c = &clients[i];
+      c->last_cnt = client_unseen(c);
+      if (c->last_cnt > 0) {
+         fprintf(fd, "(%s: %d) ", c->account->name, c->last_cnt);
+         any = true;
+      }
+   }
+   if (any) fprintf(fd, "| ");
+
+   fclose(fd);
+   return 0;
 }
 
 int setup_config(struct tls_config *cfg) {
@@ -305,18 +487,31 @@ int setup_config(struct tls_config *cfg) {
    return 0;
 }
 
-size_t load_accounts(struct Account as[]) {
-   size_t num_accounts = 0;
+// one account per line of stdin, as many as there are
+struct Account *load_accounts(size_t *num_accounts) {
+   struct Account *as = NULL;
+   size_t size = 0;
 
-   for (int i = 0; i < MAX_ACCOUNTS; i++) {
+   *num_accounts = 0;
+   while (true) {
       char *input = NULL;
       size_t length = 0;
       ssize_t bytes_read = 0;
 
-      if ((bytes_read = getline(&input, &length, stdin)) == EOF) break;
+      if ((bytes_read = getline(&input, &length, stdin)) == EOF) {
+         free(input);
+         break;
+      }
       input[strlen(input) -1] = '\0';
 
-      struct Account *a = &as[i];
+      if (*num_accounts == size) {
+         size = size == 0 ? 16 : size * 2;
+         if ((as = realloc(as, sizeof(struct Account) * size)) == NULL) {
+            err_app_("load_accounts: out of memory");
+            exit(1);
+         }
+      }
+      struct Account *a = &as[*num_accounts];
 
       if ((a->name = strtok(input, " ")) == NULL
             || (a->user = strtok(NULL, " ")) == NULL
@@ -327,40 +522,100 @@ size_t load_accounts(struct Account as[]) {
          free(input);
          continue;
       }
+      // optional: "count" when the list of unseen messages is of no use, and the mailboxes to watch
+      a->count_only = false;
+      a->num_mailboxes = 0;
+      bool too_long = false;
+      for (char *t; (t = strtok(NULL, " ")) != NULL; ) {
+         if (strcmp(t, "count") == 0) {
+            a->count_only = true;
+         } else if (strlen(t) > MAILBOX_MAX) {
+            err_app("[%s] mailbox name longer than %d: %s", a->name, MAILBOX_MAX, t);
+            too_long = true;
+         } else if (a->num_mailboxes < MAX_MAILBOXES) {
+            a->mailboxes[a->num_mailboxes++] = t;
+         }
+      }
+      if (too_long) {
+         free(input);
+         continue;
+      }
+      if (a->num_mailboxes == 0) {
+         a->mailboxes[a->num_mailboxes++] = "INBOX";
+      }
+      for (size_t k = 0; k < a->num_mailboxes; k++) {
+         if ((a->quoted[k] = quote_mailbox(a->mailboxes[k])) == NULL) {
+            err_app_("load_accounts: out of memory");
+            exit(1);
+         }
+      }
 
       printf("[%s] %s ", a->name, a->user);
       for (size_t i2 = 0; a->password[i2] != '\0'; i2++) {
          putchar((i2 % 8 == 0) ? a->password[i2] : '*');
       }
-      printf(" %s:%s\n", a->server, a->port);
-      num_accounts++;
+      printf(" %s:%s%s", a->server, a->port, a->count_only ? " count" : "");
+      for (size_t k = 0; k < a->num_mailboxes; k++) {
+         printf(" %s", a->mailboxes[k]);
+      }
+      putchar('\n');
+      (*num_accounts)++;
    }
 
-   return num_accounts;
+   return as;
 }
 
-void client_init(struct Client *c, struct tls_config *cfg, struct Account *a) {
+// "name" with its '"' and '\\' escaped; at most 2 * MAILBOX_MAX + 3 bytes with the NUL
+char *quote_mailbox(const char *name) {
+   char *q = malloc(2 * strlen(name) + 3);
+   if (q == NULL) {
+      return NULL;
+   }
+
+   char *p = q;
+   *p++ = '"';
+   for (; *name != '\0'; name++) {
+      if (*name == '"' || *name == '\\') {
+         *p++ = '\\';
+      }
+      *p++ = *name;
+   }
+   *p++ = '"';
+   *p = '\0';
+   return q;
+}
+
+void client_init(struct Client *c, struct tls_config *cfg, struct Account *a, int epoll) {
    c->account = a;
    c->config = cfg;
    c->addrinfo = NULL;
    c->tls = NULL;
    c->socket = -1;
+   c->epoll = epoll;
 
    c->phase = Disconnected;
    c->events = 0;
 
-   c->read_buffer = NULL;
-   c->rb_cur_pos = NULL;
-   c->rb_size = 0;
-   c->nb_size = sizeof(c->needle_buffer);
+   c->parser.ring = NULL;
+   c->tag[0] = '\0';
 
-   c->us_cnt = 0;
-   c->unseens = NULL;
-   c->us_size = 0;
+   seqset_init(&c->unseens);
+   uidset_init(&c->uids);
+   c->counting = false;
+   c->count = 0;
+   for (size_t i = 0; i < MAX_MAILBOXES; i++) {
+      c->folder_unseen[i] = 0;
+   }
+   c->status_time = 0;
+   c->uid_mode = false;
+   c->uidvalidity = 0;
+   c->modseq = 0;
+   c->full_sync = true;
 
    c->conn_cnt = 0;
    c->timer1 = 0;
    c->timer2 = 0;
+   c->last_cnt = -1;
 }
 
 int client_connect(struct Client *c) {
@@ -378,13 +633,16 @@ int client_connect(struct Client *c) {
    if (rc != 0) {
       const char *err = gai_strerror(rc);
       err_account(a, "getaddrinfo: %s\n", err);
-      return 2;
+      c->addrinfo = NULL;
+      rc = 2;
+      goto fail;
    }
 
    if (c->tls == NULL) {
       if ((c->tls = tls_client()) == NULL) {
          err_account_(a, "tls_client failed");
-         return 3;
+         rc = 3;
+         goto fail;
       }
    }
 
@@ -393,7 +651,8 @@ int client_connect(struct Client *c) {
    c->socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
    if (c->socket < 0) {
       err_account_(a, "socket failed");
-      return 4;
+      rc = 4;
+      goto fail;
    } else {
       log_account(a, "socket: success (%d)", c->socket);
 
@@ -403,9 +662,8 @@ int client_connect(struct Client *c) {
             log_account_(a, "connect: In Progress");
          } else {
             err_account(a, "connect: error (%d, %d)\n", rc, errno);
-
-            client_disconnect(c);
-            return 5;
+            rc = 5;
+            goto fail;
          }
       } else {
          log_account_(a, "connect: success");
@@ -415,49 +673,76 @@ int client_connect(struct Client *c) {
    rc = tls_configure(c->tls, c->config);
    if (rc != 0) {
       err_account_(a, "tls_configure failed");
-      return 6;
+      rc = 6;
+      goto fail;
    }
    log_account_(a, "tls_configure: success");
 
    if (tls_connect_socket(c->tls, c->socket, c->account->server) != 0) {
       err_account_(a, "tls_connect_socket failed");
-      return 7;
+      rc = 7;
+      goto fail;
    }
    log_account_(a, "tls_connect_socket: success");
 
-   if (c->read_buffer == NULL) {
-      if ((c->read_buffer = malloc(READ_BUFFER_SIZE)) == NULL) {
-         err_account_(a, "malloc failed");
-         return -1;
+   if (c->parser.ring == NULL) {
+      if (imap_init(&c->parser) == -1) {
+         err_account_(a, "imap_init failed");
+         rc = -1;
+         goto fail;
       }
-      c->rb_size = READ_BUFFER_SIZE;
-      c->rb_cur_pos = c->read_buffer;
    }
+   imap_reset(&c->parser);
 
-   if (c->unseens == NULL) {
-      if ((c->unseens = malloc(sizeof(int) * UNSEENS_SIZE)) == NULL) {
-         err_account_(a, "unseens: malloc failed");
-         return -1;
-      }
-      c->us_size = UNSEENS_SIZE;
+   struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = c };
+   if (epoll_ctl(c->epoll, EPOLL_CTL_ADD, c->socket, &ev) == -1) {
+      err_account(a, "epoll_ctl: %s", strerror(errno));
+      rc = 8;
+      goto fail;
    }
 
    c->phase = Connected;
-   c->events = POLLOUT;
+   c->events = EPOLLOUT;
    c->handler = NULL;
+   c->out_pos = 0;
+   c->out_len = 0;
+   c->read_wants = EPOLLIN;
+   c->write_wants = EPOLLOUT;
 
    c->seq = 0;
    c->exists = 0;
-   c->us_cnt = 0;
+   c->caps = 0;
+   c->caps_fresh = false;
+   c->qresync = false;
+   c->recount = false;
+   c->fetch = (struct Fetch) {0};
+   c->notify_asked = false;
+   c->notify = false;
+   for (size_t i = 0; i < MAX_MAILBOXES; i++) {
+      c->folder_stale[i] = true;
+   }
 
    c->conn_cnt++;
    c->timer1 = time(NULL);
    c->timer2 = 0;
 
-   for (int i = 0; i < c->us_size; i++) c->unseens[i] = -1;
-
-   snprintf(c->needle_buffer, c->nb_size, "* OK");
    return 0;
+
+fail:
+   // still Disconnected, so client_disconnect would not undo any of this
+   if (c->tls != NULL) {
+      tls_reset(c->tls);
+   }
+   if (c->socket >= 0) {
+      close(c->socket);
+      c->socket = -1;
+   }
+   if (c->addrinfo != NULL) {
+      freeaddrinfo(c->addrinfo);
+      c->addrinfo = NULL;
+   }
+   c->timer1 = time(NULL);
+   return rc;
 }
 
 void client_disconnect(struct Client *c) {
@@ -477,15 +762,17 @@ void client_disconnect(struct Client *c) {
    }
    if (c->socket > 0) {
       int rc;
+      epoll_ctl(c->epoll, EPOLL_CTL_DEL, c->socket, NULL);
       rc = shutdown(c->socket, SHUT_RDWR);
       log_account(a, "shutdown: %d", rc);
 
       rc = close(c->socket);
       log_account(a, "close: %d", rc);
 
-      c->socket = 0;
+      c->socket = -1;
    }
    freeaddrinfo(c->addrinfo);
+   c->addrinfo = NULL;
 
    c->phase = Disconnected;
    c->events = 0;
@@ -493,80 +780,125 @@ void client_disconnect(struct Client *c) {
    c->timer2 = 0;
 }
 
+// reads once into the parser's ring; > 0 bytes, 0 at EOF, < 0 error or TLS_WANT_*
 ssize_t client_read(struct Client *c) {
    struct Account *a = c->account;
 
-   size_t len = c->rb_size - (c->rb_cur_pos - c->read_buffer);
-   while (true) {
-      int rc = tls_read(c->tls, c->rb_cur_pos, len);
-      log_account(a, "<<< tls_read: %d", rc);
-
-      if (rc <= 0) {
-         switch (rc) {
-            case TLS_WANT_POLLIN:
-               err_account_(a, "tls_read: TLS_WANT_POLLIN");
-               c->events = POLLIN;
-               break;
-            case TLS_WANT_POLLOUT:
-               err_account_(a, "tls_read: TLS_WANT_POLLOUT");
-               c->events = POLLOUT;
-               break;
-         }
-         return rc;
-      }
+   size_t len;
+   char *buf = imap_space(&c->parser, &len);
+   ssize_t rc = tls_read(c->tls, buf, len);
+   log_account(a, "<<< tls_read: %zd", rc);
 
-      c->rb_cur_pos += rc;
-      if (strncmp(CRLF, c->rb_cur_pos - 2, 2) == 0) break;
+   if (rc <= 0) {
+      switch (rc) {
+         case TLS_WANT_POLLIN:
+            c->read_wants = EPOLLIN;
+            break;
+         case TLS_WANT_POLLOUT:
+            err_account_(a, "tls_read: TLS_WANT_POLLOUT");
+            c->read_wants = EPOLLOUT;
+            break;
+      }
+      client_events(c);
+      return rc;
+   }
 
-      if (rc < len) {
-         len -= rc;
-      } else {
-         size_t new_size = c->rb_size * 2;
-         void *new_ptr = realloc(c->read_buffer, new_size);
-         if (new_ptr == NULL) {
-            err_account(a, "read_buffer realloc failed: {%p} %d -> %d", c->read_buffer, c->rb_size, new_size);
-            exit(1);
-         }
+   c->read_wants = EPOLLIN;
+   imap_fill(&c->parser, rc);
+   c->timer1 = time(NULL);
+   return rc;
+}
 
-         c->rb_cur_pos = new_ptr + (c->rb_cur_pos - c->read_buffer);
-         len = c->rb_size;
-         c->read_buffer = new_ptr;
-         c->rb_size = new_size;
+// hands every complete response to the handler; -1 if the stream is not IMAP
+int client_dispatch(struct Client *c) {
+   struct Account *a = c->account;
+   struct ImapResponse r;
+   char log[200];
+   int rc = 0;
+
+   while (c->phase == Connected && c->handler != NULL && (rc = imap_next(&c->parser, &r)) > 0) {
+      imap_format(&r, log, sizeof(log));
+      log_account(a, "\"%s\"", log);
+      client_update(c, &r);
+      // an unseen number that cannot be kept drops the connection in there
+      if (c->phase != Connected || c->handler == NULL) {
+         break;
       }
+      c->handler(c, &r);
+   }
+   if (c->phase == Connected && c->handler != NULL && rc < 0) {
+      err_account_(a, "Invalid IMAP response");
+      client_disconnect(c);
+      return -1;
    }
+   return c->phase == Connected ? 0 : -1;
+}
+
+// queues a command; it goes out once epoll says the socket can take it
+ssize_t client_write(struct Client *c, const void *buf, size_t len, char *log) {
+   struct Account *a = c->account;
+   log_account(a, ">>> queued: %d", len);
+   log_account(a, "\"%s\"", log);
 
-   size_t bytes = c->rb_cur_pos - c->read_buffer;
-   if (bytes > 0) {
-      c->timer1 = time(NULL);
-      *c->rb_cur_pos = '\0';
-      c->rb_cur_pos = c->read_buffer;
+   if (c->out_pos == c->out_len) {
+      c->out_pos = c->out_len = 0;
+   }
+   if (len + 2 > sizeof(c->out) - c->out_len) {
+      memmove(c->out, c->out + c->out_pos, c->out_len - c->out_pos);
+      c->out_len -= c->out_pos;
+      c->out_pos = 0;
+   }
+   if (len + 2 > sizeof(c->out) - c->out_len) {
+      err_account_(a, "write queue full");
+      client_disconnect(c);
+      return -1;
    }
-   return bytes;
+
+   memcpy(c->out + c->out_len, buf, len);
+   memcpy(c->out + c->out_len + len, CRLF, 2);
+   c->out_len += len + 2;
+   client_events(c);
+   return len;
 }
 
-bool _client_write(struct Client *c, const void *buf, size_t len) {
-   while (len > 0) {
-      ssize_t rc = tls_write(c->tls, buf, len);
-      if (rc == TLS_WANT_POLLIN || rc == TLS_WANT_POLLOUT)
-         continue;
-      if (rc == -1) {
-         return false;
+// writes as much of the queue as TLS takes without blocking
+int client_flush(struct Client *c) {
+   struct Account *a = c->account;
+
+   while (c->out_pos < c->out_len) {
+      ssize_t rc = tls_write(c->tls, c->out + c->out_pos, c->out_len - c->out_pos);
+      if (rc == TLS_WANT_POLLIN || rc == TLS_WANT_POLLOUT) {
+         c->write_wants = (rc == TLS_WANT_POLLIN ? EPOLLIN : EPOLLOUT);
+         client_events(c);
+         return 0;
+      }
+      if (rc < 0) {
+         err_account_(a, "tls_write failed");
+         return -1;
       }
 
-      buf += rc;
-      len -= rc;
+      log_account(a, ">>> tls_write: %zd", rc);
+      c->out_pos += rc;
    }
-   return true;
+
+   c->write_wants = EPOLLOUT;
+   client_events(c);
+   return 0;
 }
 
-ssize_t client_write(struct Client *c, const void *buf, size_t len, char *log) {
-   log_account(c->account, ">>> tls_write: %d", len);
-   log_account(c->account, "\"%s\"", log);
-   
-   if (! _client_write(c, buf, len)) return -1;
-   if (! _client_write(c, CRLF, 2)) return -1;
+// tells epoll when what the client waits for changed
+void client_events(struct Client *c) {
+   const uint32_t events = c->read_wants | (c->out_pos < c->out_len ? c->write_wants : 0);
+   if (events == c->events || c->phase != Connected) {
+      c->events = events;
+      return;
+   }
 
-   return len;
+   struct epoll_event ev = { .events = events, .data.ptr = c };
+   if (epoll_ctl(c->epoll, EPOLL_CTL_MOD, c->socket, &ev) == -1) {
+      err_account(c->account, "epoll_ctl: %s", strerror(errno));
+   }
+   c->events = events;
 }
 
 int client_starttls(struct Client *c) {
@@ -577,221 +909,581 @@ int client_starttls(struct Client *c) {
       return 1;
    }
 
+   // an unfinished handshake goes on inside tls_read
    int rc = tls_handshake(c->tls);
    switch (rc) {
       case 0:
          log_account_(a, "tls_handshake: success");
-         c->events = POLLIN;
+         c->read_wants = EPOLLIN;
          break;
       case TLS_WANT_POLLIN:
          err_account_(a, "tls_handshake: TLS_WANT_POLLIN");
-         c->events = POLLIN;
+         c->read_wants = EPOLLIN;
          break;
       case TLS_WANT_POLLOUT:
          err_account_(a, "tls_handshake: TLS_WANT_POLLOUT");
-         c->events = POLLOUT;
+         c->read_wants = EPOLLOUT;
          break;
       default:
          err_account(a, "tls_handshake failed: %d", rc);
          return 2;
    }
 
+   client_events(c);
    return 0;
 }
 
-int client_login(struct Client *c, char* line) {
+// 1 if r completes the pending command with OK, -1 with NO or BAD, 0 if r is another response
+int client_done(struct Client *c, const struct ImapResponse *r) {
+   if (r->kind != ImapTagged || strcmp(r->tag, c->tag) != 0) {
+      return 0;
+   }
+   if (strcasecmp(r->name, "OK") == 0) {
+      return 1;
+   }
+
+   err_account(c->account, "%s failed: %s", r->tag, r->name);
+   return -1;
+}
+
+// takes what the server may send whatever the pending command: response codes and mailbox changes
+void client_update(struct Client *c, const struct ImapResponse *r) {
+   struct Account *a = c->account;
+   const struct ImapToken *args = r->args;
+   unsigned long num;
+
+   // "[CODE ...]" right after a status, tagged or not
+   if (r->nargs >= 2 && args[0].type == ImapOpen && args[0].p[0] == '[') {
+      if (imap_is(&args[1], "CAPABILITY")) {
+         client_capabilities(c, args + 2, r->nargs - 2);
+      } else if (imap_is(&args[1], "UIDVALIDITY") && r->nargs > 2 && imap_number(&args[2], &num)) {
+         if (num != c->uidvalidity) {
+            log_account(a, "UIDVALIDITY: %lu -> %lu", c->uidvalidity, num);
+            c->uidvalidity = num;
+            c->full_sync = true;
+         }
+      } else if (imap_is(&args[1], "HIGHESTMODSEQ") && r->nargs > 2 && imap_number(&args[2], &num)) {
+         if (num > c->seen_modseq) c->seen_modseq = num;
+      } else if (imap_is(&args[1], "NOMODSEQ")) {
+         c->nomodseq = true;
+      }
+      return;
+   }
+
+   if (r->kind != ImapUntagged) {
+      return;
+   }
+
+   if (strcasecmp(r->name, "CAPABILITY") == 0) {
+      client_capabilities(c, args, r->nargs);
+   } else if (strcasecmp(r->name, "ENABLED") == 0) {
+      for (size_t i = 0; i < r->nargs; i++) {
+         if (imap_is(&args[i], "QRESYNC")) c->qresync = true;
+      }
+   } else if (strcasecmp(r->name, "EXISTS") == 0 && r->has_number) {
+      // the sync after a SELECT covers what it reports; when counting, exists is not kept
+      // through expunges, so any EXISTS may be new mail
+      if ((c->counting || r->number > c->exists) && c->handler != client_select_sent) c->recount = true;
+      c->exists = r->number;
+      log_account(a, "Exists: %d", c->exists);
+   } else if (strcasecmp(r->name, "STATUS") == 0 && r->nargs > 0) {
+      const size_t i = account_mailbox(a, &args[0]);
+      if (i == 0) {
+         return;
+      }
+
+      bool unseen = false;
+      for (size_t k = 1; k + 1 < r->nargs; k++) {
+         if (imap_is(&args[k], "UNSEEN") && imap_number(&args[k + 1], &num)) {
+            c->folder_unseen[i] = num;
+            unseen = true;
+            log_account(a, "Unseen in %s: %lu", a->mailboxes[i], num);
+         }
+      }
+      // a NOTIFY event tells that something changed, not always what
+      if (!unseen) c->folder_stale[i] = true;
+   } else if (c->counting && (strcasecmp(r->name, "FETCH") == 0 || strcasecmp(r->name, "EXPUNGE") == 0
+            || strcasecmp(r->name, "VANISHED") == 0)) {
+      c->recount = true;
+   } else if (strcasecmp(r->name, "FETCH") == 0 && r->has_number) {
+      client_fetch(c, r);
+   } else if (strcasecmp(r->name, "EXPUNGE") == 0 && r->has_number) {
+      // with QRESYNC on, expunges come as VANISHED
+      if (!c->uid_mode) {
+         log_account(a, "Unseen Expunge: %lu", r->number);
+         seqset_expunge(&c->unseens, r->number);
+         print_unseens(c);
+      }
+
+      c->exists--;
+      log_account(a, "Exists: %d", c->exists);
+   } else if (strcasecmp(r->name, "VANISHED") == 0 && r->nargs > 0 && c->uid_mode) {
+      // "(EARLIER)" while resyncing: gone before this connection counted them in EXISTS
+      const bool earlier = r->nargs > 1 && args[0].type == ImapOpen;
+      size_t n;
+      if (vanish_unseens(c, &args[r->nargs - 1], &n) == -1) {
+         return;
+      }
+      print_unseens(c);
+
+      if (!earlier) {
+         c->exists = n < c->exists ? c->exists - n : 0;
+         log_account(a, "Exists: %d", c->exists);
+      }
+   }
+}
+
+void client_capabilities(struct Client *c, const struct ImapToken *args, size_t n) {
+   for (size_t i = 0; i < n; i++) {
+      if (imap_is(&args[i], "CONDSTORE")) {
+         c->caps |= CapCondstore;
+      } else if (imap_is(&args[i], "QRESYNC")) {
+         c->caps |= CapQresync | CapCondstore;
+      } else if (imap_is(&args[i], "ESEARCH")) {
+         c->caps |= CapEsearch;
+      } else if (imap_is(&args[i], "NOTIFY")) {
+         c->caps |= CapNotify;
+      }
+   }
+   c->caps_fresh = true;
+}
+
+// "* 12 FETCH (UID 40 FLAGS (\Seen) MODSEQ (917))"; only a FETCH with FLAGS changes unseens
+void client_fetch(struct Client *c, const struct ImapResponse *r) {
+   struct Account *a = c->account;
+   struct Fetch *f = &c->fetch;
+
+   // items alternate name and value, and a value may be a list
+   for (size_t i = 0; i < r->nargs; i++) {
+      const struct ImapToken *t = &r->args[i];
+      if (t->type == ImapOpen) {
+         f->depth++;
+      } else if (t->type == ImapClose) {
+         if (--f->depth == 1) f->item = FetchNone;
+      } else if (f->depth == 1 && f->item == FetchNone) {
+         f->item = imap_is(t, "UID") ? FetchUid : imap_is(t, "MODSEQ") ? FetchModseq
+            : imap_is(t, "FLAGS") ? FetchFlags : FetchOther;
+         f->flags = f->flags || f->item == FetchFlags;
+      } else if (f->item != FetchNone) {
+         if (f->item == FetchUid) {
+            imap_number(t, &f->uid);
+         } else if (f->item == FetchModseq) {
+            imap_number(t, &f->modseq);
+         } else if (f->item == FetchFlags) {
+            f->seen = f->seen || imap_is(t, "\\Seen");
+         }
+         if (f->depth == 1) f->item = FetchNone;
+      }
+   }
+   if (r->more) {
+      return;
+   }
+
+   const unsigned long uid = f->uid, modseq = f->modseq;
+   const bool flags = f->flags, seen = f->seen;
+   *f = (struct Fetch) {0};
+
+   if (modseq > c->seen_modseq) c->seen_modseq = modseq;
+   if (!flags) {
+      return;
+   }
+
+   const unsigned long num = c->uid_mode ? uid : r->number;
+   if (num == 0) {
+      err_account(a, "FETCH %lu without UID", r->number);
+      return;
+   }
+   if (!seen) {
+      log_account(a, "Unseen Add: %lu", num);
+      if (add_unseens(c, num) == -1) return;
+   } else {
+      log_account(a, "Unseen Remove: %lu", num);
+      if (remove_unseens(c, num, num) == -1) return;
+   }
+   print_unseens(c);
+}
+
+int client_login(struct Client *c, const struct ImapResponse *r) {
    struct Account *a = c->account;
    char buf[200], log[200];
 
-   log_account(a, "'%s'", c->needle_buffer);
-   if (strncmp(line, c->needle_buffer, c->needle_length) != 0) {
+   if (r->kind != ImapUntagged || strcasecmp(r->name, "OK") != 0) {
       return 1;
    }
 
    c->seq++;
-   int len = snprintf(buf, sizeof(buf), "A%d LOGIN %s %s", c->seq, a->user, a->password);
-   snprintf(log, sizeof(log), "A%d LOGIN %s ********", c->seq, a->user);
+   snprintf(c->tag, sizeof(c->tag), "A%zu", c->seq);
+   int len = snprintf(buf, sizeof(buf), "%s LOGIN %s %s", c->tag, a->user, a->password);
+   snprintf(log, sizeof(log), "%s LOGIN %s ********", c->tag, a->user);
    client_write(c, buf, len, log);
 
-   c->needle_length = snprintf(c->needle_buffer, c->nb_size, "A%d ", c->seq);
+   // capabilities may grow once logged in
+   c->caps = 0;
+   c->caps_fresh = false;
+
    c->handler = client_login_sent;
    return 0;
 }
 
-int client_login_sent(struct Client *c, char *line) {
-   struct Account *a = c->account;
+int client_login_sent(struct Client *c, const struct ImapResponse *r) {
    char buf[100];
 
-   log_account(a, "'%s'", c->needle_buffer);
-   if (strncmp(line, c->needle_buffer, c->needle_length) != 0) {
+   const int done = client_done(c, r);
+   if (done <= 0) {
+      if (done < 0) client_logout(c);
       return 1;
    }
 
+   if (c->caps_fresh) {
+      client_enable(c);
+      return 0;
+   }
+
+   // not sent along with the OK
    c->seq++;
-   int len = snprintf(buf, sizeof(buf), "A%d SELECT INBOX", c->seq);
+   snprintf(c->tag, sizeof(c->tag), "A%zu", c->seq);
+   int len = snprintf(buf, sizeof(buf), "%s CAPABILITY", c->tag);
    client_write(c, buf, len, buf);
 
-   c->needle_length = snprintf(c->needle_buffer, c->nb_size, "A%d OK ", c->seq);
-   c->handler = client_select_sent;
+   c->handler = client_capability_sent;
    return 0;
 }
 
-int client_select_sent(struct Client *c, char *line) {
-   struct Account *a = c->account;
-   char *p;
-
-   char exists[] = " EXISTS";
-   if ((p = strstr(line, exists)) != NULL) {
-      *p = '\0';
-      int num = strtol(&line[2], NULL, 10);
-      if (errno == ERANGE) {
-         err_account_(a, "strtol: ERANGE");
-         c->exists = 0;
-         return 1;
-      } else {
-         log_account(a, "Parsed Exists: %d", num);
-         c->exists = num;
-      }
+int client_capability_sent(struct Client *c, const struct ImapResponse *r) {
+   const int done = client_done(c, r);
+   if (done <= 0) {
+      if (done < 0) client_logout(c);
+      return 1;
+   }
+
+   client_enable(c);
+   return 0;
+}
+
+void client_enable(struct Client *c) {
+   char buf[100];
+
+   // a count needs neither UIDs nor resync
+   c->counting = c->account->count_only && (c->caps & CapEsearch) != 0;
+   if (c->counting) {
+      clear_unseens(c);
+   }
+
+   if ((c->caps & CapQresync) == 0 || c->counting) {
+      client_select(c);
+      return;
+   }
+
+   c->seq++;
+   snprintf(c->tag, sizeof(c->tag), "A%zu", c->seq);
+   int len = snprintf(buf, sizeof(buf), "%s ENABLE QRESYNC", c->tag);
+   client_write(c, buf, len, buf);
+
+   c->handler = client_enable_sent;
+}
+
+// "* ENABLED QRESYNC" sets qresync; without it the session goes on by sequence numbers
+int client_enable_sent(struct Client *c, const struct ImapResponse *r) {
+   if (client_done(c, r) == 0) {
       return 0;
    }
 
-   log_account(a, "'%s'", c->needle_buffer);
-   if (strncmp(line, c->needle_buffer, c->needle_length) != 0) {
+   client_select(c);
+   return 0;
+}
+
+// resumes from uidvalidity and modseq when QRESYNC is on and both are known
+void client_select(struct Client *c) {
+   struct Account *a = c->account;
+   char buf[256];
+   int len;
+
+   // sequence numbers of an earlier connection mean nothing now
+   if (!c->qresync || !c->uid_mode || c->modseq == 0) {
+      c->full_sync = true;
+   }
+   c->uid_mode = c->qresync;
+   c->nomodseq = false;
+   c->seen_modseq = 0;
+   c->recount = false;
+
+   c->seq++;
+   snprintf(c->tag, sizeof(c->tag), "A%zu", c->seq);
+   if (c->qresync && !c->full_sync) {
+      log_account(a, "Resync from: %lu %lu", c->uidvalidity, c->modseq);
+      len = snprintf(buf, sizeof(buf), "%s SELECT %s (QRESYNC (%lu %lu))", c->tag, a->quoted[0],
+            c->uidvalidity, c->modseq);
+   } else if ((c->caps & CapCondstore) != 0) {
+      len = snprintf(buf, sizeof(buf), "%s SELECT %s (CONDSTORE)", c->tag, a->quoted[0]);
+   } else {
+      len = snprintf(buf, sizeof(buf), "%s SELECT %s", c->tag, a->quoted[0]);
+   }
+   client_write(c, buf, len, buf);
+
+   c->handler = client_select_sent;
+}
+
+int client_select_sent(struct Client *c, const struct ImapResponse *r) {
+   struct Account *a = c->account;
+
+   const int done = client_done(c, r);
+   if (done <= 0) {
+      if (done < 0) client_logout(c);
       return 1;
    }
 
+   if (c->nomodseq) {
+      c->modseq = 0;
+      c->full_sync = true;
+   }
+   if (c->uid_mode && !c->full_sync) {
+      // the VANISHED and FETCH since modseq came with the SELECT
+      if (c->seen_modseq > c->modseq) c->modseq = c->seen_modseq;
+      log_account(a, "Resynced to: %lu", c->modseq);
+      print_unseens(c);
+      client_idle(c);
+      return 0;
+   }
+
    client_search(c);
    return 0;
 }
 
+// only what changed since modseq when the server keeps mod-sequences; messages
+// turning seen are not found but come as FETCH while the mailbox is selected
 void client_search(struct Client *c) {
    char buf[100];
-
-   for (int i = 0; i < c->us_cnt; i++) c->unseens[i] = -1;
-   c->us_cnt = 0;
+   const char *uid = c->uid_mode ? "UID " : "";
+   int len;
 
    c->seq++;
-   int len = snprintf(buf, sizeof(buf), "A%d SEARCH (UNSEEN)", c->seq);
+   snprintf(c->tag, sizeof(c->tag), "A%zu", c->seq);
+   if (c->counting) {
+      // "* ESEARCH (TAG "A5") COUNT 42" instead of every number
+      c->recount = false;
+      len = snprintf(buf, sizeof(buf), "%s SEARCH RETURN (COUNT) (UNSEEN)", c->tag);
+   } else if (c->full_sync || c->nomodseq || (c->caps & CapCondstore) == 0 || c->modseq == 0) {
+      clear_unseens(c);
+      c->full_sync = true;
+      c->modseq = 0;
+      len = snprintf(buf, sizeof(buf), "%s %sSEARCH (UNSEEN)", c->tag, uid);
+   } else {
+      len = snprintf(buf, sizeof(buf), "%s %sSEARCH (MODSEQ %lu UNSEEN)", c->tag, uid, c->modseq + 1);
+   }
    client_write(c, buf, len, buf);
 
-   c->needle_length = snprintf(c->needle_buffer, c->nb_size, "A%d OK ", c->seq);
+   c->search_modseq = false;
    c->handler = client_search_sent;
 }
 
-int client_search_sent(struct Client *c, char *line) {
+int client_search_sent(struct Client *c, const struct ImapResponse *r) {
    struct Account *a = c->account;
-   char buf[100], *p;
 
-   char search[] = "* SEARCH";
-   if ((p = strstr(line, search)) != NULL) {
-      p += sizeof(search) -1;
-      if (*p == '\0') {
-         return 1;
+   // a long result comes in pieces, each with more numbers
+   if (r->kind == ImapUntagged && strcasecmp(r->name, "SEARCH") == 0) {
+      for (size_t i = 0; i < r->nargs; i++) {
+         const struct ImapToken *t = &r->args[i];
+         unsigned long num;
+         if (t->type == ImapOpen || t->type == ImapClose) {
+            c->search_modseq = t->type == ImapOpen;
+         } else if (c->search_modseq) {
+            // the highest mod-sequence of the messages found
+            if (imap_number(t, &num) && num > c->seen_modseq) c->seen_modseq = num;
+         } else if (imap_number(t, &num)) {
+            if (add_unseens(c, num) == -1) return 1;
+         } else {
+            err_account(a, "token error: %.*s", (int) t->len, t->p);
+         }
+      }
+      if (!r->more) {
+         print_unseens(c);
+         c->recount = false;
       }
-      p++;
-      log_account(a, "Search: '%s'", p);
 
-      p = strtok(p, " ");
-      while (p != NULL) {
-         log_account(a, "token: %s", p);
+      return 0;
+   }
 
-         int num = strtol(p, NULL, 10);
-         if (errno == ERANGE) {
-            err_account(a, "token error: %s", p);
-         } else {
-            add_unseens(c, num);
+   if (r->kind == ImapUntagged && strcasecmp(r->name, "ESEARCH") == 0) {
+      for (size_t i = 0; i + 1 < r->nargs; i++) {
+         unsigned long num;
+         if (imap_is(&r->args[i], "COUNT") && imap_number(&r->args[i + 1], &num)) {
+            c->count = num;
+            print_unseens(c);
          }
-
-         p = strtok(NULL, " ");
       }
-      print_unseens(c);
-
+      // changes reported before the result are in it
+      c->recount = false;
       return 0;
    }
 
-   log_account(a, "'%s'", c->needle_buffer);
-   if (strncmp(line, c->needle_buffer, c->needle_length) != 0) {
+   const int done = client_done(c, r);
+   if (done <= 0) {
+      if (done < 0) client_logout(c);
       return 1;
    }
 
-   c->seq++;
-   int len = snprintf(buf, sizeof(buf), "A%d IDLE", c->seq);
-   client_write(c, buf, len, buf);
+   // every change the server reported so far is in
+   c->full_sync = false;
+   if (c->seen_modseq > c->modseq) c->modseq = c->seen_modseq;
+   if (c->modseq > 0) log_account(a, "Synced to: %lu", c->modseq);
 
-   c->needle_length = snprintf(c->needle_buffer, c->nb_size, "A%d OK ", c->seq);
-   c->handler = client_idle_sent;
-   c->timer2 = time(NULL);
+   client_idle(c);
    return 0;
 }
 
-int client_idle_sent(struct Client *c, char *line) {
+// one STATUS per stale mailbox, written together; c->tag is the last of them
+void client_status(struct Client *c) {
    struct Account *a = c->account;
+   char buf[200];
 
-   if (strncmp(line, c->needle_buffer, c->needle_length) == 0) {
-      client_search(c);
-      return 0;
+   for (size_t i = 1; i < a->num_mailboxes; i++) {
+      if (!c->folder_stale[i]) {
+         continue;
+      }
+      c->folder_stale[i] = false;
+
+      c->seq++;
+      snprintf(c->tag, sizeof(c->tag), "A%zu", c->seq);
+      int len = snprintf(buf, sizeof(buf), "%s STATUS %s (UNSEEN)", c->tag, a->quoted[i]);
+      if (client_write(c, buf, len, buf) == -1) {
+         return;
+      }
    }
 
-   if (strncmp(line, "* ", 2) != 0) {
+   c->handler = client_status_sent;
+   c->status_time = time(NULL);
+}
+
+// the answers went to client_update; a NO, e.g. for a missing mailbox, keeps its last count
+int client_status_sent(struct Client *c, const struct ImapResponse *r) {
+   if (client_done(c, r) == 0) {
       return 0;
    }
 
-   char *tkn1 = line + 2;
-   char *p= strstr(tkn1, " ");
-   if (p == NULL) {
-      err_account_(a, "Invalid IDLE response");
-      return 1;
+   client_idle(c);
+   return 0;
+}
+
+// without NOTIFY nothing tells about the other mailboxes: ask again now and then
+void client_status_check_interval(struct Client *c, time_t now) {
+   struct Account *a = c->account;
+
+   if (a->num_mailboxes < 2 || c->notify || now - c->status_time <= STATUS_INTERVAL) {
+      return;
    }
-   *p = '\0';
-   if (strcmp(tkn1, "OK") == 0) {
-      return 0;
-   } else if (strcmp(tkn1, "BYE") == 0) {
-      client_idle_done(c);
-      c->handler = client_idle_done_sent2;
+
+   for (size_t i = 1; i < a->num_mailboxes; i++) {
+      c->folder_stale[i] = true;
+   }
+   client_idle_done(c);
+   c->handler = client_idle_done_sent3;
+}
+
+void client_notify(struct Client *c) {
+   struct Account *a = c->account;
+   char buf[1024];
+
+   c->notify_asked = true;
+
+   c->seq++;
+   snprintf(c->tag, sizeof(c->tag), "A%zu", c->seq);
+   size_t len = snprintf(buf, sizeof(buf), "%s NOTIFY SET (SELECTED (MessageNew MessageExpunge FlagChange)) "
+         "(MAILBOXES (", c->tag);
+   for (size_t i = 1; i < a->num_mailboxes && len < sizeof(buf); i++) {
+      len += snprintf(buf + len, sizeof(buf) - len, "%s%s", i > 1 ? " " : "", a->quoted[i]);
+   }
+   if (len < sizeof(buf)) {
+      len += snprintf(buf + len, sizeof(buf) - len, ") (MessageNew MessageExpunge FlagChange))");
+   }
+   if (len >= sizeof(buf)) {
+      err_account_(a, "NOTIFY too long");
+      client_idle(c);
+      return;
+   }
+   client_write(c, buf, len, buf);
+
+   c->handler = client_notify_sent;
+}
+
+// refused, e.g. with NOTIFICATIONOVERFLOW: the other mailboxes are polled instead
+int client_notify_sent(struct Client *c, const struct ImapResponse *r) {
+   const int done = client_done(c, r);
+   if (done == 0) {
       return 0;
    }
 
-   char *tkn2 = p + 1;
-   p = strstr(tkn2, " ");
-   char *rest;
-   if (p == NULL) {
-      log_account(a, "Tokens: %s|%s", tkn1, tkn2);
-      rest = tkn2;
-   } else {
-      *p = '\0';
-      rest = p + 1;
-      log_account(a, "Tokens: %s|%s|%s", tkn1, tkn2, rest);
+   c->notify = done > 0;
+   client_idle(c);
+   return 0;
+}
+
+// idles once the selected mailbox is searched, the others have their counts, and NOTIFY is set
+void client_idle(struct Client *c) {
+   struct Account *a = c->account;
+   char buf[100];
+
+   if (c->recount) {
+      client_search(c);
+      return;
+   }
+   for (size_t i = 1; i < a->num_mailboxes; i++) {
+      if (c->folder_stale[i]) {
+         client_status(c);
+         return;
+      }
+   }
+   if (a->num_mailboxes > 1 && (c->caps & CapNotify) != 0 && !c->notify_asked) {
+      client_notify(c);
+      return;
    }
 
-   const int num = strtol(tkn1, NULL, 10);
+   c->seq++;
+   snprintf(c->tag, sizeof(c->tag), "A%zu", c->seq);
+   int len = snprintf(buf, sizeof(buf), "%s IDLE", c->tag);
+   client_write(c, buf, len, buf);
 
-   if (strcmp(tkn2, "FETCH") == 0) {
-      if ((strstr(rest, "\\Seen")) == NULL) {
-         log_account(a, "Unseen Add: %d", num);
-         add_unseens(c, num);
-         print_unseens(c);
+   c->handler = client_idle_sent;
+   c->timer2 = time(NULL);
+}
+
+int client_idle_sent(struct Client *c, const struct ImapResponse *r) {
+   struct Account *a = c->account;
+
+   const int done = client_done(c, r);
+   if (done != 0) {
+      if (done > 0) {
+         client_search(c);
       } else {
-         log_account(a, "Unseen Remove: %d", num);
-         remove_unseens(c, num);
-         print_unseens(c);
+         client_logout(c);
       }
-   } else if (strcmp(tkn2, "EXPUNGE") == 0) {
-      log_account(a, "Unseen Remove: %d", num);
-      remove_unseens(c, num);
-      print_unseens(c);
+      return 0;
+   }
 
-      c->exists--;
-      log_account(a, "Exists: %d", c->exists);
+   // "+ idling" and the like
+   if (r->kind != ImapUntagged) {
+      return 0;
+   }
 
-      log_account_(a, "Unseen Decrement");
-      decrement_unseens(c, num);
-      print_unseens(c);
-   } else if (strcmp(tkn2, "EXISTS") == 0) {
-      c->exists = num;
-      log_account(a, "Exists: %d", c->exists);
+   if (strcasecmp(r->name, "OK") == 0) {
+      return 0;
+   } else if (strcasecmp(r->name, "BYE") == 0) {
+      client_idle_done(c);
+      c->handler = client_idle_done_sent2;
+      return 0;
+   }
 
+   // EXISTS, FETCH, EXPUNGE, VANISHED and STATUS went to client_update
+   if (c->recount) {
       client_idle_done(c);
       c->handler = client_idle_done_sent1;
+      return 0;
+   }
+   for (size_t i = 1; i < a->num_mailboxes; i++) {
+      if (c->folder_stale[i]) {
+         client_idle_done(c);
+         c->handler = client_idle_done_sent3;
+         return 0;
+      }
    }
 
    return 0;
@@ -812,8 +1504,8 @@ void client_idle_done(struct Client *c) {
    client_write(c, done, 4, done);
 }
 
-int client_idle_done_sent1(struct Client *c, char *line) {
-   if (strncmp(line, c->needle_buffer, c->needle_length) != 0) {
+int client_idle_done_sent1(struct Client *c, const struct ImapResponse *r) {
+   if (client_done(c, r) == 0) {
       return 0;
    }
 
@@ -821,8 +1513,8 @@ int client_idle_done_sent1(struct Client *c, char *line) {
    return 0;
 }
 
-int client_idle_done_sent2(struct Client *c, char *line) {
-   if (strncmp(line, c->needle_buffer, c->needle_length) != 0) {
+int client_idle_done_sent2(struct Client *c, const struct ImapResponse *r) {
+   if (client_done(c, r) == 0) {
       return 0;
    }
 
@@ -830,20 +1522,28 @@ int client_idle_done_sent2(struct Client *c, char *line) {
    return 0;
 }
 
+int client_idle_done_sent3(struct Client *c, const struct ImapResponse *r) {
+   if (client_done(c, r) == 0) {
+      return 0;
+   }
+
+   client_idle(c);
+   return 0;
+}
+
 void client_logout(struct Client *c) {
-   struct Account *a = c->account;
    char buf[100];
 
    c->seq++;
-   int len = snprintf(buf, sizeof(buf), "A%d LOGOUT", c->seq);
+   snprintf(c->tag, sizeof(c->tag), "A%zu", c->seq);
+   int len = snprintf(buf, sizeof(buf), "%s LOGOUT", c->tag);
    client_write(c, buf, len, buf);
 
-   snprintf(c->needle_buffer, c->nb_size, "A%d OK", c->seq);
    c->handler = client_logout_sent;
 }
 
-int client_logout_sent(struct Client *c, char *line) {
-   if (strncmp(line, c->needle_buffer, c->needle_length) != 0) {
+int client_logout_sent(struct Client *c, const struct ImapResponse *r) {
+   if (client_done(c, r) == 0) {
       return 0;
    }
 
@@ -851,60 +1551,120 @@ int client_logout_sent(struct Client *c, char *line) {
    return 0;
 }
 
-void add_unseens(struct Client* c, int num) {
-   int i = 0;
-   for (; i < c->us_cnt; i++) {
-      if (c->unseens[i] == num) {
-         return;
-      }
+// index of the mailbox named by t in a->mailboxes, or 0 for the selected one and any other
+size_t account_mailbox(struct Account *a, const struct ImapToken *t) {
+   if (t->type != ImapAtom && t->type != ImapQuoted && t->type != ImapLiteral) {
+      return 0;
    }
-   if (i > c->us_size) {
-      size_t new_size = c->us_size * 2;
-      int *new_ptr = realloc(c->unseens, sizeof(int) * new_size);
-      if (new_ptr == NULL) {
-         err_account(c->account, "unseens realloc failed: {%p} %d -> %d", c->unseens, c->us_size, new_size);
-         exit(1);
-      }
 
-      c->unseens = new_ptr;
-      c->us_size = new_size;
-      for (int j = i; j < c->us_size; j++) c->unseens[j] = -1;
+   // quoted names come unescaped from imap_next, so the bytes compare as they are
+   for (size_t i = 1; i < a->num_mailboxes; i++) {
+      const char *name = a->mailboxes[i];
+      if (strlen(name) != t->len) {
+         continue;
+      }
+      // INBOX is the one name without case
+      if (strncmp(name, t->p, t->len) == 0 || (strcasecmp(name, "INBOX") == 0 && strncasecmp(t->p, "INBOX", 5) == 0)) {
+         return i;
+      }
    }
+   return 0;
+}
 
-   c->us_cnt++;
-   c->unseens[i] = num;
+// -1 if num cannot be kept, and then the connection is dropped
+int add_unseens(struct Client* c, unsigned long num) {
+   const int rc = c->uid_mode ? uidset_add(&c->uids, num) : seqset_add(&c->unseens, num);
+   if (rc == -1) lost_unseens(c, num);
+   return rc;
 }
 
-void remove_unseens(struct Client* c, int num) {
-   for (int i = 0; i < c->us_cnt; i++) {
-      if (c->unseens[i] == num) {
-         c->us_cnt--;
-         if (i == c->us_cnt) {
-            c->unseens[i] = -1;
-         } else {
-            c->unseens[i] = c->unseens[c->us_cnt];
-         }
-         break;
+// -1 if removing lo to hi would need memory there is none of, as add_unseens
+int remove_unseens(struct Client *c, unsigned long lo, unsigned long hi) {
+   if (c->uid_mode) {
+      if (uidset_remove(&c->uids, lo, hi) == -1) {
+         lost_unseens(c, lo);
+         return -1;
       }
+      return 0;
    }
+   for (unsigned long u = lo; u != 0 && u <= hi; u++) {
+      seqset_remove(&c->unseens, u);
+   }
+   return 0;
 }
 
-void decrement_unseens(struct Client* c, int num) {
-   for (int i = 0; i < c->us_cnt; i++) {
-      if (c->unseens[i] > num) {
-         c->unseens[i] -= 1;
+void clear_unseens(struct Client *c) {
+   seqset_clear(&c->unseens);
+   uidset_clear(&c->uids);
+}
+
+size_t count_unseens(struct Client *c) {
+   return c->uid_mode ? c->uids.count : c->unseens.count;
+}
+
+unsigned long next_unseen(struct Client *c, unsigned long after) {
+   return c->uid_mode ? uidset_next(&c->uids, after) : seqset_next(&c->unseens, after);
+}
+
+// the set no longer matches the mailbox: start over with a full search on the next connection
+void lost_unseens(struct Client *c, unsigned long num) {
+   err_account(c->account, "unseens: cannot keep %lu", num);
+   clear_unseens(c);
+   c->full_sync = true;
+   c->modseq = 0;
+   client_disconnect(c);
+}
+
+// removes the UIDs of a set like "3:5,9" from unseens and puts how many it names in *n
+int vanish_unseens(struct Client *c, const struct ImapToken *t, size_t *n) {
+   unsigned long lo = 0, hi = 0;
+   unsigned long *num = &lo;
+
+   *n = 0;
+   for (size_t i = 0; i <= t->len; i++) {
+      const char ch = i < t->len ? t->p[i] : ',';
+      if (ch >= '0' && ch <= '9') {
+         *num = *num * 10 + (ch - '0');
+      } else if (ch == ':') {
+         num = &hi;
+      } else if (ch == ',') {
+         if (num == &lo) hi = lo;
+         if (lo > hi) {
+            const unsigned long tmp = lo;
+            lo = hi;
+            hi = tmp;
+         }
+         *n += hi - lo + 1;
+
+         log_account(c->account, "Unseen Vanished: %lu:%lu", lo, hi);
+         if (remove_unseens(c, lo, hi) == -1) {
+            return -1;
+         }
+
+         lo = hi = 0;
+         num = &lo;
       }
    }
+   return 0;
 }
 
+// logs the count and as many of the numbers as fit on a line
 void print_unseens(struct Client *c) {
    char buf[300];
-   char *p = buf;
-   p += snprintf(buf, sizeof(buf), "Unseen: %d (", c->us_cnt);
-   for (int i = 0; i < c->us_cnt; i++) {
-      p+= snprintf(p, sizeof(buf) - (p - buf), "%d,", c->unseens[i]);
+
+   if (c->counting) {
+      log_account(c->account, "Unseen: %zu", c->count);
+      return;
+   }
+   size_t len = snprintf(buf, sizeof(buf), "Unseen: %zu (", count_unseens(c));
+   for (unsigned long n = next_unseen(c, 0); n != 0; n = next_unseen(c, n)) {
+      if (len + 24 > sizeof(buf)) {
+         len += snprintf(buf + len, sizeof(buf) - len, "...");
+         break;
+      }
+      len += snprintf(buf + len, sizeof(buf) - len, "%lu,", n);
    }
-   p += snprintf(p, sizeof(buf), ")");
+   snprintf(buf + len, sizeof(buf) - len, ")");
 
    log_account(c->account, "%s", buf);
 }
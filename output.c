@@ -0,0 +1,321 @@
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <xcb/xcb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+#include "dwmstatus.h"
+
+/*
+ * The status line is published as the WM_NAME of the root window of
+ * every configured display, and optionally as the UTF-8 _NET_WM_NAME.
+ * The xcb backend sends the property changes without waiting for any
+ * reply; the Xlib backend keeps the original XStoreName path. A display
+ * whose connection breaks is dropped, and dwmstatus quits once none are
+ * left. The "file" backend appends each status line to the file at
+ * output_path (NULL: stdout) and "null" discards it; both work without
+ * an X server.
+ */
+
+#define MAX_OUTPUTS 8
+
+struct Output;
+
+struct OutputBackend {
+  const char *name;
+  bool x11;
+  int (*open)(struct Output *o, const char *display);
+  void (*set)(struct Output *o, const char *text, size_t len);
+  void (*drain)(struct Output *o);
+  bool (*broken)(struct Output *o);
+  void (*close)(struct Output *o);
+};
+
+struct Output {
+  const struct OutputBackend *backend;
+  const char *display;
+  void *conn;
+  uint32_t root;
+  uint32_t net_wm_name, utf8_string;
+  int fd;
+  bool failed;
+};
+
+static struct Output outputs[MAX_OUTPUTS];
+static size_t noutputs;
+static bool set_utf8;
+
+/* Xlib */
+
+/*
+ * A broken connection is marked failed instead of exiting, and on_x drops
+ * it like the xcb backend does; Xlib turns later calls on it into no-ops.
+ */
+static int xlib_io_error(Display *d) {
+  return 0;
+}
+
+static void xlib_io_exit(Display *d, void *arg) {
+  for (size_t i = 0; i < noutputs; i++)
+    if (outputs[i].conn == d)
+      outputs[i].failed = true;
+}
+
+static int xlib_open(struct Output *o, const char *display) {
+  Display *d = XOpenDisplay(display);
+  if (d == NULL)
+    return -1;
+  XSetIOErrorHandler(xlib_io_error);
+  XSetIOErrorExitHandler(d, xlib_io_exit, NULL);
+  o->conn = d;
+  o->failed = false;
+  o->root = DefaultRootWindow(d);
+  o->fd = ConnectionNumber(d);
+  if (set_utf8) {
+    o->net_wm_name = XInternAtom(d, "_NET_WM_NAME", False);
+    o->utf8_string = XInternAtom(d, "UTF8_STRING", False);
+  }
+  return 0;
+}
+
+static void xlib_set(struct Output *o, const char *text, size_t len) {
+  Display *d = o->conn;
+  XStoreName(d, o->root, text);
+  if (set_utf8)
+    XChangeProperty(d, o->root, o->net_wm_name, o->utf8_string, 8, PropModeReplace,
+		    (const unsigned char *) text, len);
+  XFlush(d);
+}
+
+static void xlib_drain(struct Output *o) {
+  Display *d = o->conn;
+  /* nothing is selected, but replies and errors still have to be drained */
+  while (XPending(d)) {
+    XEvent ev;
+    XNextEvent(d, &ev);
+  }
+}
+
+static bool xlib_broken(struct Output *o) {
+  return o->failed;
+}
+
+static void xlib_close(struct Output *o) {
+  XCloseDisplay(o->conn);
+}
+
+/* xcb */
+
+static int xcb_open(struct Output *o, const char *display) {
+  int screen;
+  xcb_connection_t *c = xcb_connect(display, &screen);
+  if (xcb_connection_has_error(c)) {
+    xcb_disconnect(c);
+    return -1;
+  }
+
+  xcb_screen_iterator_t it = xcb_setup_roots_iterator(xcb_get_setup(c));
+  for (; it.rem > 0 && screen > 0; screen--)
+    xcb_screen_next(&it);
+  if (it.rem == 0) {
+    xcb_disconnect(c);
+    return -1;
+  }
+  o->conn = c;
+  o->root = it.data->root;
+  o->fd = xcb_get_file_descriptor(c);
+
+  if (set_utf8) {
+    /* both requests go out before either reply is waited for */
+    xcb_intern_atom_cookie_t name = xcb_intern_atom(c, 0, strlen("_NET_WM_NAME"), "_NET_WM_NAME");
+    xcb_intern_atom_cookie_t type = xcb_intern_atom(c, 0, strlen("UTF8_STRING"), "UTF8_STRING");
+    xcb_intern_atom_reply_t *r;
+    if ((r = xcb_intern_atom_reply(c, name, NULL)) != NULL) {
+      o->net_wm_name = r->atom;
+      free(r);
+    }
+    if ((r = xcb_intern_atom_reply(c, type, NULL)) != NULL) {
+      o->utf8_string = r->atom;
+      free(r);
+    }
+  }
+  return 0;
+}
+
+static void xcb_set(struct Output *o, const char *text, size_t len) {
+  xcb_connection_t *c = o->conn;
+  xcb_change_property(c, XCB_PROP_MODE_REPLACE, o->root, XCB_ATOM_WM_NAME, XCB_ATOM_STRING,
+		      8, len, text);
+  if (set_utf8 && o->net_wm_name != XCB_NONE)
+    xcb_change_property(c, XCB_PROP_MODE_REPLACE, o->root, o->net_wm_name, o->utf8_string,
+			8, len, text);
+  xcb_flush(c);
+}
+
+static void xcb_drain(struct Output *o) {
+  xcb_generic_event_t *ev;
+  while ((ev = xcb_poll_for_event(o->conn)) != NULL) {
+    if (ev->response_type == 0)
+      fprintf(stderr, "%s: X error %d\n", o->display, ((xcb_generic_error_t *) ev)->error_code);
+    free(ev);
+  }
+}
+
+static bool xcb_broken(struct Output *o) {
+  return xcb_connection_has_error(o->conn) != 0;
+}
+
+static void xcb_close(struct Output *o) {
+  xcb_disconnect(o->conn);
+}
+
+/* file and null */
+
+static int file_open(struct Output *o, const char *path) {
+  o->conn = NULL;
+  if (path == NULL) {
+    o->fd = STDOUT_FILENO;
+    o->display = "stdout";
+  } else if ((o->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) == -1) {
+    return -1;
+  }
+  /* regular files cannot be watched by epoll; errors show up on write */
+  o->failed = false;
+  return 0;
+}
+
+static void file_set(struct Output *o, const char *text, size_t len) {
+  struct iovec iov[2] = { { (void *) text, len }, { "\n", 1 } };
+  ssize_t r;
+
+  while ((r = writev(o->fd, iov, 2)) == -1 && errno == EINTR)
+    ;
+  if (r == -1)
+    o->failed = true;
+}
+
+static bool file_broken(struct Output *o) {
+  return o->failed;
+}
+
+static void file_close(struct Output *o) {
+  if (o->fd != STDOUT_FILENO)
+    close(o->fd);
+}
+
+static int null_open(struct Output *o, const char *display) {
+  o->display = "null";
+  o->fd = -1;
+  return 0;
+}
+
+static void null_set(struct Output *o, const char *text, size_t len) {
+}
+
+static bool null_broken(struct Output *o) {
+  return false;
+}
+
+static void null_close(struct Output *o) {
+}
+
+static const struct OutputBackend backends[] = {
+  { "xcb", true, xcb_open, xcb_set, xcb_drain, xcb_broken, xcb_close },
+  { "xlib", true, xlib_open, xlib_set, xlib_drain, xlib_broken, xlib_close },
+  { "file", false, file_open, file_set, NULL, file_broken, file_close },
+  { "null", false, null_open, null_set, NULL, null_broken, null_close },
+};
+
+static void drop(struct Output *o) {
+  fprintf(stderr, "output lost: %s\n", o->display);
+  if (o->backend->x11)
+    loop_del(o->fd);
+  o->backend->close(o);
+  *o = outputs[--noutputs];
+  if (noutputs == 0)
+    loop_quit(EXIT_FAILURE);
+}
+
+static void on_x(int fd, uint32_t events, void *arg) {
+  struct Output *o = NULL;
+  for (size_t i = 0; i < noutputs && o == NULL; i++)
+    if (outputs[i].fd == fd)
+      o = &outputs[i];
+  if (o == NULL)
+    return;
+
+  if (!(events & (EPOLLHUP | EPOLLERR)))
+    o->backend->drain(o);
+  if (events & (EPOLLHUP | EPOLLERR) || o->backend->broken(o))
+    drop(o);
+}
+
+/*
+ * Connects to every display in displays (NULL: $DISPLAY) with the named
+ * backend, or opens path with a backend that is not X. Returns -1 unless
+ * all of them could be opened.
+ */
+int output_open(const char *const *displays, size_t n, const char *path, const char *backend,
+		bool utf8) {
+  const struct OutputBackend *be = NULL;
+  for (size_t i = 0; i < LENGTH(backends); i++)
+    if (strcmp(backends[i].name, backend) == 0)
+      be = &backends[i];
+  if (be == NULL) {
+    fprintf(stderr, "output: unknown backend [%s]\n", backend);
+    return -1;
+  }
+  if (!be->x11) {
+    displays = &path;
+    n = 1;
+  }
+  if (n == 0 || n > MAX_OUTPUTS) {
+    fprintf(stderr, "output: need 1 to %d displays\n", MAX_OUTPUTS);
+    return -1;
+  }
+
+  set_utf8 = utf8;
+  for (size_t i = 0; i < n; i++) {
+    struct Output *o = &outputs[noutputs];
+    o->backend = be;
+    o->display = displays[i];
+    if (be->x11 && o->display == NULL && (o->display = getenv("DISPLAY")) == NULL) {
+      fprintf(stderr, "Envvar DISPLAY not defined\n");
+      return -1;
+    }
+    if (be->open(o, o->display) == -1) {
+      fprintf(stderr, "output: cannot open [%s]\n", o->display);
+      return -1;
+    }
+    noutputs++;
+    if (be->x11 && loop_add(o->fd, EPOLLIN, on_x, NULL) == -1)
+      return -1;
+  }
+  return 0;
+}
+
+/* Publishes text (NUL-terminated, len bytes) on every output. */
+void output_set(const char *text, size_t len) {
+  for (size_t i = 0; i < noutputs; i++) {
+    outputs[i].backend->set(&outputs[i], text, len);
+    if (outputs[i].backend->broken(&outputs[i]))
+      drop(&outputs[i--]);
+  }
+}
+
+/* Name of the first X display published on, or NULL without X. */
+const char *output_display(void) {
+  return noutputs > 0 && outputs[0].backend->x11 ? outputs[0].display : NULL;
+}
+
+void output_close(void) {
+  for (size_t i = 0; i < noutputs; i++)
+    outputs[i].backend->close(&outputs[i]);
+  noutputs = 0;
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "dwmstatus.h"
+#include "dwmstatus-plugin.h"
+
+/*
+ * Loads the configured plugins (see dwmstatus-plugin.h) and gives them
+ * the event loop, the scheduler and the segment table. A plugin segment
+ * is the table's own buffer: the plugin writes into it and only tells
+ * how long the text is, so there is no copy and no comparison. An
+ * unchanged text is still caught before it reaches X, by publish().
+ */
+
+#define MAX_PLUGINS 8
+#define MAX_PLUGIN_TIMERS 32
+
+struct PluginState {
+  void *handle;
+  const struct dwmstatus_plugin *plugin;
+  void *state;
+};
+
+static struct PluginState plugins[MAX_PLUGINS];
+static size_t nplugins;
+/* a free timer has period 0 */
+static struct Job timers[MAX_PLUGIN_TIMERS];
+
+static struct dwmstatus_segment *host_segment(const char *name) {
+  return (struct dwmstatus_segment *) segment_add(name, SegPlugin);
+}
+
+static char *host_segment_buffer(struct dwmstatus_segment *seg, size_t *size) {
+  struct Segment *s = (struct Segment *) seg;
+  *size = sizeof(s->text);
+  return s->text;
+}
+
+static void host_segment_done(struct dwmstatus_segment *seg, size_t len) {
+  struct Segment *s = (struct Segment *) seg;
+  s->len = len < sizeof(s->text) ? len : sizeof(s->text) - 1;
+  /* end like a status file so the renderer adds a separator */
+  if (s->len > 0 && s->text[s->len - 1] != '\n')
+    s->text[s->len++] = '\n';
+  segments_dirty = true;
+  if (stats_on) {
+    s->refreshed = stats_clock();
+    if (segments_changed == 0)
+      segments_changed = s->refreshed;
+  }
+}
+
+static void host_segment_clear(struct dwmstatus_segment *seg) {
+  segment_set((struct Segment *) seg, "", 0);
+}
+
+static void host_segment_drop(struct dwmstatus_segment *seg) {
+  segment_remove((struct Segment *) seg);
+}
+
+static struct dwmstatus_timer *host_timer(long long period, long long slack,
+					  void (*fn)(void *arg, time_t now), void *arg) {
+  for (size_t i = 0; i < MAX_PLUGIN_TIMERS; i++) {
+    struct Job *j = &timers[i];
+    if (j->period != 0)
+      continue;
+    *j = (struct Job) { .period = period, .slack = slack, .run = fn, .arg = arg };
+    if (sched_add(j) == -1) {
+      j->period = 0;
+      return NULL;
+    }
+    return (struct dwmstatus_timer *) j;
+  }
+  fprintf(stderr, "plugin: too many timers\n");
+  return NULL;
+}
+
+static void host_timer_stop(struct dwmstatus_timer *t) {
+  struct Job *j = (struct Job *) t;
+  sched_remove(j);
+  j->period = 0;
+}
+
+static const struct dwmstatus_host host = {
+  .abi = DWMSTATUS_PLUGIN_ABI,
+  .size = sizeof(struct dwmstatus_host),
+  .segment = host_segment,
+  .segment_buffer = host_segment_buffer,
+  .segment_done = host_segment_done,
+  .segment_clear = host_segment_clear,
+  .segment_drop = host_segment_drop,
+  .watch = loop_add,
+  .rewatch = loop_mod,
+  .unwatch = loop_del,
+  .timer = host_timer,
+  .timer_stop = host_timer_stop,
+};
+
+/* Loads and opens every plugin of cfg. Returns -1 if one fails. */
+int plugin_open(const struct Plugin *cfg, size_t n) {
+  if (n > MAX_PLUGINS) {
+    fprintf(stderr, "plugin: at most %d plugins\n", MAX_PLUGINS);
+    return -1;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    struct PluginState *p = &plugins[nplugins];
+    if ((p->handle = dlopen(cfg[i].path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+      fprintf(stderr, "plugin: %s\n", dlerror());
+      return -1;
+    }
+    p->plugin = dlsym(p->handle, DWMSTATUS_PLUGIN_SYMBOL);
+    if (p->plugin == NULL || p->plugin->abi != DWMSTATUS_PLUGIN_ABI || p->plugin->open == NULL) {
+      fprintf(stderr, "plugin: [%s] is not a dwmstatus plugin of ABI %d\n", cfg[i].path,
+	      DWMSTATUS_PLUGIN_ABI);
+      dlclose(p->handle);
+      return -1;
+    }
+    p->state = NULL;
+    if (p->plugin->open(&host, cfg[i].arg, &p->state) == -1) {
+      /* not unloaded: it may have registered callbacks before failing */
+      fprintf(stderr, "plugin: [%s] failed to start\n", p->plugin->name);
+      return -1;
+    }
+    nplugins++;
+  }
+  return 0;
+}
+
+/* Lets the plugins bring their segments up to date before a render. */
+void plugin_render(void) {
+  for (size_t i = 0; i < nplugins; i++)
+    if (plugins[i].plugin->render != NULL)
+      plugins[i].plugin->render(plugins[i].state);
+}
+
+void plugin_close(void) {
+  for (size_t i = 0; i < nplugins; i++)
+    if (plugins[i].plugin->close != NULL)
+      plugins[i].plugin->close(plugins[i].state);
+  /* the objects stay mapped: their callbacks may still be registered */
+  nplugins = 0;
+}
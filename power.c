@@ -0,0 +1,229 @@
+#include <X11/Xlib.h>
+#include <X11/Xlibint.h>
+#include <X11/extensions/Xge.h>
+#include <X11/extensions/dpms.h>
+#include <X11/extensions/dpmsproto.h>
+#include <X11/extensions/scrnsaver.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+
+#include "dwmstatus.h"
+
+/*
+ * Chooses the tick profile from the power and screen state. On AC the
+ * clocks tick as their formats need; on battery they tick once a minute
+ * and the kernel may delay wakeups by more timer slack; while the screen
+ * is off (DPMS) or the screensaver is active, periodic work stops.
+ *
+ * Screensaver changes arrive as X events, and so do DPMS changes from a
+ * server with DPMS 1.2; while the screen is off the timer then stops and
+ * the AC adapter is read again when it comes back. An older server has
+ * no DPMS events, so a screen blanked by DPMS alone is polled every
+ * POLL_OFF seconds to come back quickly. With the screen on, DPMS and
+ * the AC adapter are polled every POLL_ON seconds.
+ */
+
+#define POWER_SUPPLY "/sys/class/power_supply"
+#define MAX_MAINS 4
+#define POLL_ON 30
+#define POLL_OFF 2
+
+static int mains[MAX_MAINS];
+static size_t nmains;
+static Display *dsp;
+static int saver_event = -1;
+static int dpms_opcode = -1;	/* set when DPMS InfoNotify events are selected */
+static bool saver_on, dpms_ok;
+static int timer_fd = -1, timer_secs = -1;
+static struct Power state = { .on_ac = true };
+static const struct PowerConfig *cfg;
+static void (*changed)(const struct Power *p);
+
+static bool read_flag(int fd) {
+  char c = '0';
+  while (pread(fd, &c, 1, 0) == -1 && errno == EINTR)
+    ;
+  return c == '1';
+}
+
+/* Opens the online file of every AC adapter ("Mains" supply). */
+static void open_mains(void) {
+  DIR *d = opendir(POWER_SUPPLY);
+  struct dirent *e;
+
+  if (d == NULL)
+    return;
+  while (nmains < MAX_MAINS && (e = readdir(d)) != NULL) {
+    char path[PATH_MAX], type[16] = "";
+    if (e->d_name[0] == '.')
+      continue;
+    snprintf(path, sizeof(path), POWER_SUPPLY "/%s/type", e->d_name);
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+      continue;
+    const ssize_t r = pread(fd, type, sizeof(type) - 1, 0);
+    close(fd);
+    if (r <= 0 || strncmp(type, "Mains", 5) != 0)
+      continue;
+
+    snprintf(path, sizeof(path), POWER_SUPPLY "/%s/online", e->d_name);
+    if ((mains[nmains] = open(path, O_RDONLY | O_CLOEXEC)) != -1)
+      nmains++;
+  }
+  closedir(d);
+}
+
+/* Keeps the DPMS events as cookies without data: only their arrival matters. */
+static Bool dpms_event(Display *d, XGenericEventCookie *cookie, xEvent *wire) {
+  const xGenericEvent *ge = (const xGenericEvent *) wire;
+  cookie->type = ge->type & 0x7f;
+  cookie->serial = _XSetLastRequestRead(d, (xGenericReply *) wire);
+  cookie->send_event = (ge->type & 0x80) != 0;
+  cookie->display = d;
+  cookie->extension = ge->extension;
+  cookie->evtype = ge->evtype;
+  cookie->data = NULL;
+  return True;
+}
+
+/*
+ * Asks for DPMS InfoNotify events, which DPMS 1.2 servers send as
+ * generic events. libXext before 1.3.5 has no DPMSSelectInput, so the
+ * request is built here the way libXext does.
+ */
+static void dpms_listen(void) {
+  Display *const dpy = dsp;	/* the name the Xlibint.h macros use */
+  int opcode, event_base, error_base, major, minor;
+  xDPMSSelectInputReq *req;
+
+  if (!XQueryExtension(dsp, DPMSExtensionName, &opcode, &event_base, &error_base)
+      || !DPMSGetVersion(dsp, &major, &minor) || major < 1 || (major == 1 && minor < 2)
+      || !XGEQueryVersion(dsp, &major, &minor))
+    return;
+  XESetWireToEventCookie(dsp, opcode, dpms_event);
+
+  LockDisplay(dpy);
+  GetReq(DPMSSelectInput, req);
+  req->reqType = opcode;
+  req->dpmsReqType = X_DPMSSelectInput;
+  req->eventMask = DPMSInfoNotifyMask;
+  UnlockDisplay(dpy);
+  SyncHandle();
+  dpms_opcode = opcode;
+}
+
+/* Sets the poll period; 0 stops the timer. */
+static void arm(int secs) {
+  if (secs == timer_secs)
+    return;
+  timer_secs = secs;
+  const struct itimerspec its = { { secs, 0 }, { secs, 0 } };
+  if (timerfd_settime(timer_fd, 0, &its, NULL) == -1)
+    perror("power: timerfd_settime");
+}
+
+/* Re-reads the state and applies the profile if it changed. */
+static void check(bool force) {
+  struct Power now = { .on_ac = nmains == 0 };
+
+  for (size_t i = 0; i < nmains; i++)
+    now.on_ac |= read_flag(mains[i]);
+
+  bool dpms_off = false;
+  if (dpms_ok) {
+    CARD16 level;
+    BOOL enabled;
+    dpms_off = DPMSInfo(dsp, &level, &enabled) && enabled && level != DPMSModeOn;
+  }
+  now.screen_off = saver_on || dpms_off;
+
+  /* off, the screen is polled only if no event would say it came back */
+  if (!now.screen_off)
+    arm(POLL_ON);
+  else
+    arm(dpms_off && dpms_opcode == -1 ? POLL_OFF : 0);
+
+  if (!force && now.on_ac == state.on_ac && now.screen_off == state.screen_off)
+    return;
+  state = now;
+
+  prctl(PR_SET_TIMERSLACK, (unsigned long) (state.on_ac ? cfg->ac_slack : cfg->battery_slack));
+  sched_pause(state.screen_off);
+  changed(&state);
+}
+
+static void on_timer(int fd, uint32_t events, void *arg) {
+  uint64_t expirations;
+  if (read(fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+    perror("power: timerfd");
+  check(false);
+}
+
+static void on_x(int fd, uint32_t events, void *arg) {
+  if (events & (EPOLLHUP | EPOLLERR)) {
+    /* the output layer reports the lost display; stop asking it */
+    loop_del(fd);
+    saver_on = dpms_ok = false;
+    saver_event = dpms_opcode = -1;
+    /* no event will end a pause any more */
+    check(false);
+    return;
+  }
+
+  /* a DPMS event only wakes us: check asks for the level */
+  while (XPending(dsp)) {
+    XEvent ev;
+    XNextEvent(dsp, &ev);
+    if (ev.type == saver_event)
+      saver_on = ((XScreenSaverNotifyEvent *) &ev)->state == ScreenSaverOn;
+  }
+  check(false);
+}
+
+/*
+ * Starts following the power and screen state of display (NULL: no
+ * screen state). changed is called with the new state, once right away.
+ */
+int power_open(const struct PowerConfig *c, const char *display, void (*fn)(const struct Power *p)) {
+  int event_base, error_base;
+
+  cfg = c;
+  changed = fn;
+  open_mains();
+
+  if (display != NULL && (dsp = XOpenDisplay(display)) == NULL)
+    fprintf(stderr, "power: cannot open display [%s], screen state unknown\n", display);
+  if (dsp != NULL) {
+    const Window root = DefaultRootWindow(dsp);
+    if (XScreenSaverQueryExtension(dsp, &event_base, &error_base)) {
+      XScreenSaverInfo *info = XScreenSaverAllocInfo();
+      if (info != NULL && XScreenSaverQueryInfo(dsp, root, info))
+	saver_on = info->state == ScreenSaverOn;
+      XFree(info);
+      XScreenSaverSelectInput(dsp, root, ScreenSaverNotifyMask);
+      saver_event = event_base + ScreenSaverNotify;
+    }
+    dpms_ok = DPMSQueryExtension(dsp, &event_base, &error_base) && DPMSCapable(dsp);
+    if (dpms_ok)
+      dpms_listen();
+    XFlush(dsp);
+    if (loop_add(ConnectionNumber(dsp), EPOLLIN, on_x, NULL) == -1)
+      return -1;
+  }
+
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd == -1 || loop_add(timer_fd, EPOLLIN, on_timer, NULL) == -1) {
+    perror("power: timerfd");
+    return -1;
+  }
+  check(true);
+  return 0;
+}
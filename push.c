@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "dwmstatus.h"
+
+/*
+ * Producers connect to a SOCK_SEQPACKET socket and send one message per
+ * update: the segment name, a newline, then the segment text. An empty
+ * text removes the segment. Segments outlive the connection that set
+ * them, so one-shot writers such as socat work as well as long-lived
+ * producers. Messages with an empty name are requests: "\nshm" is
+ * answered with the shared-memory slot region (see dwmstatus-shm.h),
+ * "\nstats" with the counters and histograms of stats.c as text.
+ */
+
+#define MAX_CLIENTS 16
+
+static struct sockaddr_un addr;
+static int listen_fd = -1;
+static int clients[MAX_CLIENTS];
+static size_t nclients;
+
+static void drop(int fd) {
+  loop_del(fd);
+  close(fd);
+  for (size_t i = 0; i < nclients; i++) {
+    if (clients[i] == fd) {
+      clients[i] = clients[--nclients];
+      break;
+    }
+  }
+}
+
+static void send_stats(int fd) {
+  char buf[8192];
+  const size_t len = stats_format(buf, sizeof(buf));
+  if (send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) == -1)
+    perror("push: stats");
+}
+
+static void request(int fd, const char *msg, size_t len) {
+  if (len == 3 && memcmp(msg, "shm", 3) == 0)
+    shmseg_send(fd);
+  else if (len == 5 && memcmp(msg, "stats", 5) == 0)
+    send_stats(fd);
+  else
+    fprintf(stderr, "push: unknown request\n");
+}
+
+static void handle(int fd, const char *msg, size_t len) {
+  const char *nl = memchr(msg, '\n', len);
+  const size_t name_len = nl != NULL ? (size_t) (nl - msg) : len;
+  char name[SEGMENT_NAME_MAX];
+
+  if (name_len == 0 && nl != NULL) {
+    request(fd, nl + 1, len - 1);
+    return;
+  }
+
+  if (name_len == 0 || name_len >= sizeof(name) || memchr(msg, '/', name_len) != NULL) {
+    fprintf(stderr, "push: invalid segment name\n");
+    return;
+  }
+  memcpy(name, msg, name_len);
+  name[name_len] = '\0';
+
+  const char *text = nl != NULL ? nl + 1 : msg + len;
+  const size_t text_len = msg + len - text;
+  struct Segment *s;
+
+  if (text_len == 0) {
+    if ((s = segment_get(name)) != NULL && s->owner == SegPush)
+      segment_remove(s);
+    return;
+  }
+  if ((s = segment_add(name, SegPush)) != NULL)
+    segment_set(s, text, text_len);
+}
+
+static void on_client(int fd, uint32_t events, void *arg) {
+  char msg[SEGMENT_NAME_MAX + STATUS_SIZE];
+  ssize_t len;
+
+  while ((len = recv(fd, msg, sizeof(msg), MSG_DONTWAIT | MSG_TRUNC)) > 0)
+    handle(fd, msg, (size_t) len < sizeof(msg) ? (size_t) len : sizeof(msg));
+
+  if (len == 0 || (len == -1 && errno != EAGAIN && errno != EINTR)
+      || (events & (EPOLLHUP | EPOLLERR)))
+    drop(fd);
+}
+
+static void on_accept(int fd, uint32_t events, void *arg) {
+  int cfd;
+
+  while ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+    if (nclients == MAX_CLIENTS || loop_add(cfd, EPOLLIN, on_client, NULL) == -1) {
+      fprintf(stderr, "push: too many producers\n");
+      close(cfd);
+      continue;
+    }
+    clients[nclients++] = cfd;
+  }
+}
+
+/*
+ * Listens for producers on path, or on $XDG_RUNTIME_DIR/dwmstatus.sock
+ * if path is NULL. Returns -1 if the socket cannot be set up.
+ */
+int push_open(const char *path) {
+  const char *dir = getenv("XDG_RUNTIME_DIR");
+
+  addr.sun_family = AF_UNIX;
+  if (path != NULL)
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  else if (dir != NULL)
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/dwmstatus.sock", dir);
+  else
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/dwmstatus-%d.sock", (int) getuid());
+
+  listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd == -1) {
+    perror("push: socket");
+    return -1;
+  }
+
+  /* a previous instance may have left its socket behind */
+  unlink(addr.sun_path);
+  const mode_t old = umask(077);
+  const int rc = bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr));
+  umask(old);
+
+  if (rc == -1 || listen(listen_fd, MAX_CLIENTS) == -1
+      || loop_add(listen_fd, EPOLLIN, on_accept, NULL) == -1) {
+    fprintf(stderr, "push: cannot listen on %s (%d)\n", addr.sun_path, errno);
+    close(listen_fd);
+    listen_fd = -1;
+    return -1;
+  }
+  return 0;
+}
+
+void push_close(void) {
+  if (listen_fd == -1)
+    return;
+  while (nclients > 0)
+    drop(clients[0]);
+  loop_del(listen_fd);
+  close(listen_fd);
+  unlink(addr.sun_path);
+  listen_fd = -1;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "dwmstatus.h"
+
+/*
+ * Reads a batch of already open files from offset 0 with one
+ * io_uring_enter: every read is queued on the submission ring, then a
+ * single call submits them and waits for all completions. Without
+ * io_uring (old kernel, or disabled by sysctl or seccomp) the batch
+ * falls back to one pread per file. The ring is driven with the raw
+ * system calls so there is no liburing dependency.
+ */
+
+#define RING_ENTRIES 64
+
+static int ring_fd = -1;
+static unsigned *sq_tail, *sq_mask, *sq_array;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static unsigned sq_entries;
+
+/* Sets up the ring; returns -1 if reads have to use the pread fallback. */
+int reader_init(void) {
+  struct io_uring_params p = { 0 };
+
+  ring_fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+  if (ring_fd == -1)
+    return -1;
+
+  size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single)
+    sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+
+  char *sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+		  IORING_OFF_SQ_RING);
+  char *cq = single ? sq : mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				ring_fd, IORING_OFF_CQ_RING);
+  sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+	      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+    perror("reader: mmap");
+    close(ring_fd);
+    ring_fd = -1;
+    return -1;
+  }
+
+  sq_tail = (unsigned *) (sq + p.sq_off.tail);
+  sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+  sq_array = (unsigned *) (sq + p.sq_off.array);
+  cq_head = (unsigned *) (cq + p.cq_off.head);
+  cq_tail = (unsigned *) (cq + p.cq_off.tail);
+  cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+  sq_entries = p.sq_entries;
+  return 0;
+}
+
+static void read_plain(struct ReadOp *op) {
+  while ((op->res = pread(op->fd, op->buf, op->len, 0)) == -1 && errno == EINTR)
+    ;
+  if (op->res == -1)
+    op->res = -errno;
+}
+
+/* Submits ops[0..n), n <= sq_entries, and waits for all of them. */
+static int read_ring(struct ReadOp *ops, size_t n) {
+  unsigned tail = *sq_tail;
+  for (size_t i = 0; i < n; i++, tail++) {
+    const unsigned idx = tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = ops[i].fd;
+    sqe->addr = (uintptr_t) ops[i].buf;
+    sqe->len = ops[i].len;
+    sqe->off = 0;
+    sqe->user_data = i;
+    sq_array[idx] = idx;
+  }
+  atomic_store_explicit((_Atomic unsigned *) sq_tail, tail, memory_order_release);
+
+  size_t submit = n, done = 0;
+  while (done < n) {
+    if (syscall(__NR_io_uring_enter, ring_fd, submit, n - done, IORING_ENTER_GETEVENTS, NULL, 0) == -1) {
+      if (errno == EINTR)
+	continue;
+      return -1;
+    }
+    submit = 0;
+
+    unsigned head = *cq_head;
+    const unsigned ctail = atomic_load_explicit((_Atomic unsigned *) cq_tail, memory_order_acquire);
+    for (; head != ctail; head++, done++) {
+      const struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+      ops[cqe->user_data].res = cqe->res;
+    }
+    atomic_store_explicit((_Atomic unsigned *) cq_head, head, memory_order_release);
+  }
+  return 0;
+}
+
+/*
+ * Reads up to ops[i].len bytes from offset 0 of every ops[i].fd into
+ * ops[i].buf. ops[i].res is the byte count or a negative errno.
+ */
+void reader_batch(struct ReadOp *ops, size_t n) {
+  for (size_t i = 0; i < n;) {
+    const size_t chunk = n - i < sq_entries ? n - i : sq_entries;
+    if (ring_fd == -1 || read_ring(ops + i, chunk) == -1) {
+      if (ring_fd != -1) {
+	/* completions may still be in flight: stop using the ring */
+	perror("reader: io_uring_enter");
+	close(ring_fd);
+	ring_fd = -1;
+      }
+      for (size_t j = i; j < n; j++)
+	read_plain(&ops[j]);
+      return;
+    }
+    /* kernels before 5.6 know the ring but not IORING_OP_READ */
+    for (size_t j = i; j < i + chunk; j++)
+      if (ops[j].res == -EINVAL)
+	read_plain(&ops[j]);
+    i += chunk;
+  }
+}
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "dwmstatus.h"
+
+/*
+ * Periodic work is kept in a min-heap ordered by the latest time each
+ * job may run (deadline + slack). The loop's deadline is set for the top
+ * of the heap only, and a wakeup also runs every other job whose
+ * deadline has already passed, so jobs with some slack ride along with
+ * stricter ones instead of waking the process again. Deadlines are
+ * multiples of the period in wall-clock time, which keeps a minute clock
+ * on :00 and lines up jobs with related periods. A CLOCK_REALTIME
+ * timerfd that never expires tells when the clock is set.
+ */
+
+#define MAX_JOBS 64
+
+static struct Job *heap[MAX_JOBS];
+static size_t njobs;
+static int timer_fd = -1;
+static bool paused;
+
+static long long realtime_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+static long long latest(const struct Job *j) {
+  return j->deadline + j->slack;
+}
+
+static void swap(size_t a, size_t b) {
+  struct Job *t = heap[a];
+  heap[a] = heap[b];
+  heap[b] = t;
+  heap[a]->index = a;
+  heap[b]->index = b;
+}
+
+static void sift_up(size_t i) {
+  while (i > 0 && latest(heap[i]) < latest(heap[(i - 1) / 2])) {
+    swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void sift_down(size_t i) {
+  while (true) {
+    size_t m = i, l = 2 * i + 1, r = l + 1;
+    if (l < njobs && latest(heap[l]) < latest(heap[m]))
+      m = l;
+    if (r < njobs && latest(heap[r]) < latest(heap[m]))
+      m = r;
+    if (m == i)
+      return;
+    swap(i, m);
+    i = m;
+  }
+}
+
+static void next_deadline(struct Job *j, long long now) {
+  j->deadline = (now / j->period + 1) * j->period;
+}
+
+static void on_deadline(void);
+
+static void arm(void) {
+  loop_set_deadline(njobs > 0 && !paused ? latest(heap[0]) : 0, on_deadline);
+}
+
+static void run(struct Job *j, long long now) {
+  next_deadline(j, now);
+  sift_down(j->index);
+  sift_up(j->index);
+  j->run(j->arg, now / NSEC);
+}
+
+static void on_deadline(void) {
+  const long long now = realtime_ns();
+
+  while (njobs > 0 && latest(heap[0]) <= now)
+    run(heap[0], now);
+  /* coalesce: anything already due runs now rather than on its own wakeup */
+  for (size_t i = 0; i < njobs; i++) {
+    if (heap[i]->deadline <= now) {
+      run(heap[i], now);
+      i = (size_t) -1;
+    }
+  }
+  arm();
+}
+
+/* Realigns every job to the current time and runs them all. */
+static void realign(void) {
+  const long long now = realtime_ns();
+  for (size_t i = 0; i < njobs; i++)
+    heap[i]->deadline = now - heap[i]->slack;
+  on_deadline();
+}
+
+/* Arms the timerfd so that only setting the clock ends its wait. */
+static void watch_clock(void) {
+  const struct itimerspec its = { .it_value.tv_sec = (time_t) 1 << 33 };
+  if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL) == -1)
+    perror("sched: timerfd_settime");
+}
+
+static void on_timer(int fd, uint32_t events, void *arg) {
+  uint64_t expirations;
+  if (read(fd, &expirations, sizeof(expirations)) == -1 && errno == ECANCELED && !paused)
+    /* the clock was set: realign everything and run it once */
+    realign();
+  watch_clock();
+}
+
+int sched_init(void) {
+  timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd == -1 || loop_add(timer_fd, EPOLLIN, on_timer, NULL) == -1) {
+    perror("sched: timerfd");
+    return -1;
+  }
+  watch_clock();
+  return 0;
+}
+
+/*
+ * Runs j->run every j->period nanoseconds, on wall-clock multiples of the
+ * period, at most j->slack late. The first run is at the next multiple.
+ */
+int sched_add(struct Job *j) {
+  if (njobs == MAX_JOBS || j->period <= 0) {
+    fprintf(stderr, "sched_add: cannot schedule job\n");
+    return -1;
+  }
+
+  next_deadline(j, realtime_ns());
+  j->index = njobs;
+  heap[njobs++] = j;
+  sift_up(j->index);
+  arm();
+  return 0;
+}
+
+void sched_remove(struct Job *j) {
+  const size_t i = j->index;
+  if (i >= njobs || heap[i] != j)
+    return;
+
+  swap(i, --njobs);
+  if (i < njobs) {
+    sift_down(i);
+    sift_up(i);
+  }
+  arm();
+}
+
+/* Changes the period of a scheduled job; it next runs on the new grid. */
+void sched_set_period(struct Job *j, long long period, long long slack) {
+  j->period = period;
+  j->slack = slack;
+  if (j->index < njobs && heap[j->index] == j) {
+    next_deadline(j, realtime_ns());
+    sift_down(j->index);
+    sift_up(j->index);
+    arm();
+  }
+}
+
+/*
+ * Stops running jobs until resumed; resuming realigns them and runs each
+ * once, as after a clock change.
+ */
+void sched_pause(bool pause) {
+  if (pause == paused)
+    return;
+  paused = pause;
+  if (paused)
+    arm();
+  else
+    realign();
+}
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dwmstatus.h"
+
+bool segments_dirty = true;
+/* when the first change not yet published was made, if stats are on */
+long long segments_changed;
+
+static struct Segment pool[MAX_SEGMENTS];
+static struct Segment *order[MAX_SEGMENTS];
+static struct Segment *free_list[MAX_SEGMENTS];
+static size_t nsegments, nfree;
+static bool pool_ready;
+static const struct SegmentRule *rules;
+static size_t nrules;
+
+/* Index of the first segment whose name is not less than name. */
+static size_t lower_bound(const char *name) {
+  size_t lo = 0, hi = nsegments;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (strcmp(order[mid]->name, name) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+struct Segment *segment_get(const char *name) {
+  size_t i = lower_bound(name);
+  if (i < nsegments && strcmp(order[i]->name, name) == 0)
+    return order[i];
+  return NULL;
+}
+
+size_t segment_count(void) {
+  return nsegments;
+}
+
+struct Segment *segment_at(size_t i) {
+  return order[i];
+}
+
+/* Sets the width and priority rules applied to segments added later. */
+void segments_configure(const struct SegmentRule *r, size_t n) {
+  rules = r;
+  nrules = n;
+}
+
+/*
+ * Returns the segment called name, creating it for owner. Returns NULL if
+ * the table is full or the name belongs to another source.
+ */
+struct Segment *segment_add(const char *name, enum SegmentOwner owner) {
+  if (!pool_ready) {
+    for (size_t i = 0; i < MAX_SEGMENTS; i++)
+      free_list[i] = &pool[MAX_SEGMENTS - 1 - i];
+    nfree = MAX_SEGMENTS;
+    pool_ready = true;
+  }
+
+  size_t i = lower_bound(name);
+  if (i < nsegments && strcmp(order[i]->name, name) == 0) {
+    if (order[i]->owner == owner)
+      return order[i];
+    fprintf(stderr, "segment_add: [%s] is taken by another source\n", name);
+    return NULL;
+  }
+
+  if (nfree == 0 || strlen(name) >= SEGMENT_NAME_MAX) {
+    fprintf(stderr, "segment_add: cannot add [%s]\n", name);
+    return NULL;
+  }
+
+  struct Segment *s = free_list[--nfree];
+  strcpy(s->name, name);
+  s->owner = owner;
+  s->len = 0;
+  s->width = s->priority = 0;
+  s->refreshed = 0;
+  for (size_t r = 0; r < nrules; r++) {
+    if (strcmp(rules[r].name, name) == 0) {
+      s->width = rules[r].width;
+      s->priority = rules[r].priority;
+    }
+  }
+
+  memmove(&order[i + 1], &order[i], (nsegments - i) * sizeof(order[0]));
+  order[i] = s;
+  nsegments++;
+  return s;
+}
+
+void segment_remove(struct Segment *s) {
+  size_t i = lower_bound(s->name);
+  if (i == nsegments || order[i] != s)
+    return;
+
+  memmove(&order[i], &order[i + 1], (nsegments - i - 1) * sizeof(order[0]));
+  nsegments--;
+  free_list[nfree++] = s;
+  if (s->len > 0)
+    segments_dirty = true;
+}
+
+bool segment_set(struct Segment *s, const char *buf, size_t len) {
+  if (stats_on)
+    s->refreshed = stats_clock();
+  if (len > sizeof(s->text))
+    len = sizeof(s->text);
+  if (len == s->len && memcmp(s->text, buf, len) == 0)
+    return false;
+
+  memcpy(s->text, buf, len);
+  s->len = len;
+  segments_dirty = true;
+  if (stats_on && segments_changed == 0)
+    segments_changed = s->refreshed;
+  return true;
+}
+
+/*
+ * Rendering copies the text between line breaks with memcpy, finding
+ * the breaks with memchr, so the common case never looks at single
+ * bytes. Only a segment that has to be cut is walked character by
+ * character, to cut it on a UTF-8 and \x01 color code boundary; a cut
+ * segment that used colors gets a "\x01\x01" reset so the color does not
+ * leak into the next one.
+ */
+
+#define RESET "\x01\x01"
+#define RESET_LEN (sizeof(RESET) - 1)
+
+static const char *find(const char *p, const char *end, int c) {
+  const char *r = memchr(p, c, end - p);
+  return r != NULL ? r : end;
+}
+
+/*
+ * Length of the longest prefix of run that fits in room bytes and *cols
+ * columns without splitting a character or a color code. Color codes
+ * take no columns. *cols is reduced by the columns used.
+ */
+static size_t fit(const char *run, size_t len, size_t room, size_t *cols) {
+  size_t i = 0;
+  while (i < len) {
+    const unsigned char c = run[i];
+    size_t n = 1, w = 1;
+    if (c == '\x01')
+      n = 2, w = 0;
+    else if (c >= 0xf0)
+      n = 4;
+    else if (c >= 0xe0)
+      n = 3;
+    else if (c >= 0xc0)
+      n = 2;
+    if (n > len - i)
+      n = len - i;
+    if (i + n > room || w > *cols)
+      break;
+    i += n;
+    *cols -= w;
+  }
+  return i;
+}
+
+/*
+ * Renders s into out (or only measures it if out is NULL), with line
+ * breaks turned into SEPARATOR, in at most room bytes and s->width
+ * columns. Trailing line breaks are kept whenever the segment is shown
+ * at all, so a cut segment is still separated from the next. With cut,
+ * room for a color reset is set aside. Returns the bytes used.
+ */
+static size_t render(char *out, const struct Segment *s, size_t room, bool cut) {
+  const char *end = s->text + s->len, *body_end = end;
+  while (body_end > s->text && (body_end[-1] == '\n' || body_end[-1] == '\r'))
+    body_end--;
+  const size_t tail = (end - body_end) * SEP_LEN;
+  const bool colored = memchr(s->text, '\x01', s->len) != NULL;
+
+  if (room < tail)
+    return 0;
+  room -= tail;
+  if (cut && colored)
+    room = room > RESET_LEN ? room - RESET_LEN : 0;
+
+  size_t cols = s->width > 0 ? (size_t) s->width : SIZE_MAX, used = 0;
+  const char *rp = s->text, *nl = find(rp, body_end, '\n'), *cr = find(rp, body_end, '\r');
+  bool truncated = false;
+  while (rp < body_end) {
+    if (nl < rp)
+      nl = find(rp, body_end, '\n');
+    if (cr < rp)
+      cr = find(rp, body_end, '\r');
+    const char *brk = nl < cr ? nl : cr;
+
+    size_t n = brk - rp;
+    if (n > room - used || cols != SIZE_MAX) {
+      n = fit(rp, n, room - used, &cols);
+      truncated = rp + n < brk;
+    }
+    if (out != NULL)
+      memcpy(out + used, rp, n);
+    used += n;
+    rp += n;
+    if (truncated || brk == body_end)
+      break;
+
+    if (room - used < SEP_LEN || cols < SEP_LEN) {
+      truncated = true;
+      break;
+    }
+    if (out != NULL)
+      memcpy(out + used, SEPARATOR, SEP_LEN);
+    used += SEP_LEN;
+    if (cols != SIZE_MAX)
+      cols -= SEP_LEN;
+    rp = brk + 1;
+  }
+
+  if (truncated && colored) {
+    if (out != NULL)
+      memcpy(out + used, RESET, RESET_LEN);
+    used += RESET_LEN;
+  }
+  for (const char *bp = body_end; bp < end; bp++) {
+    if (out != NULL)
+      memcpy(out + used, SEPARATOR, SEP_LEN);
+    used += SEP_LEN;
+  }
+  return used;
+}
+
+/*
+ * Concatenates the first MAX_FILE segments into buf, replacing line
+ * breaks with SEPARATOR. If they do not fit, the segments with the lowest
+ * priority are cut first, the last of equal ones first, and dropped if
+ * nothing of them fits. Returns the number of bytes written; buf is
+ * NUL-terminated.
+ */
+size_t segments_render(char *buf, size_t cap) {
+  const size_t n = nsegments < MAX_FILE ? nsegments : MAX_FILE;
+  size_t need[MAX_FILE], room[MAX_FILE], total = 0;
+
+  for (size_t i = 0; i < n; i++)
+    total += room[i] = need[i] = render(NULL, order[i], SIZE_MAX, false);
+
+  /* take the overflow from the least important segments */
+  size_t over = total > cap - 1 ? total - (cap - 1) : 0;
+  while (over > 0) {
+    size_t victim = n;
+    for (size_t i = 0; i < n; i++)
+      if (room[i] == need[i] && need[i] > 0
+	  && (victim == n || order[i]->priority <= order[victim]->priority))
+	victim = i;
+    if (victim == n)
+      break;
+    const size_t cut = over < need[victim] ? over : need[victim];
+    room[victim] = need[victim] - cut;
+    over -= cut;
+  }
+
+  char *p = buf;
+  for (size_t i = 0; i < n; i++)
+    p += render(p, order[i], room[i], room[i] < need[i]);
+  *p = '\0';
+  segments_dirty = false;
+  return p - buf;
+}
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "seqset.h"
+
+void seqset_init(struct SeqSet *s) {
+   s->words = NULL;
+   s->size = 0;
+   s->used = 0;
+   s->count = 0;
+}
+
+void seqset_free(struct SeqSet *s) {
+   free(s->words);
+   seqset_init(s);
+}
+
+// keeps the memory for the next SEARCH
+void seqset_clear(struct SeqSet *s) {
+   if (s->used > 0) memset(s->words, 0, s->used * sizeof(uint64_t));
+   s->used = 0;
+   s->count = 0;
+}
+
+// -1 if num is 0, above SEQSET_MAX or the map cannot grow to it
+int seqset_add(struct SeqSet *s, unsigned long num) {
+   const size_t w = num / 64;
+
+   if (num == 0 || num > SEQSET_MAX) return -1;
+
+   if (w >= s->size) {
+      size_t size = s->size > 0 ? s->size : 16;
+      while (size <= w) size *= 2;
+      uint64_t *words = realloc(s->words, size * sizeof(uint64_t));
+      if (words == NULL) return -1;
+      memset(words + s->size, 0, (size - s->size) * sizeof(uint64_t));
+      s->words = words;
+      s->size = size;
+   }
+
+   const uint64_t bit = (uint64_t) 1 << (num % 64);
+   if ((s->words[w] & bit) == 0) {
+      s->words[w] |= bit;
+      s->count++;
+   }
+   if (w >= s->used) s->used = w + 1;
+   return 0;
+}
+
+static void trim(struct SeqSet *s) {
+   while (s->used > 0 && s->words[s->used - 1] == 0) s->used--;
+}
+
+void seqset_remove(struct SeqSet *s, unsigned long num) {
+   if (!seqset_has(s, num)) return;
+
+   s->words[num / 64] &= ~((uint64_t) 1 << (num % 64));
+   s->count--;
+   trim(s);
+}
+
+bool seqset_has(const struct SeqSet *s, unsigned long num) {
+   return num / 64 < s->used && (s->words[num / 64] >> (num % 64) & 1) != 0;
+}
+
+// removes num and moves every member above it down by one, as EXPUNGE does
+void seqset_expunge(struct SeqSet *s, unsigned long num) {
+   const size_t w = num / 64;
+   if (w >= s->used) return;
+
+   if (seqset_has(s, num)) s->count--;
+
+   const unsigned b = num % 64;
+   const uint64_t below = ((uint64_t) 1 << b) - 1;
+   uint64_t *words = s->words;
+   words[w] = (words[w] & below) | ((words[w] >> 1) & ~below);
+   for (size_t i = w + 1; i < s->used; i++) {
+      words[i - 1] |= words[i] << 63;
+      words[i] >>= 1;
+   }
+   trim(s);
+}
+
+// the smallest member above after, or 0 if there is none
+unsigned long seqset_next(const struct SeqSet *s, unsigned long after) {
+   size_t w = (after + 1) / 64;
+   if (w >= s->used) return 0;
+
+   uint64_t word = s->words[w] & (~(uint64_t) 0 << ((after + 1) % 64));
+   while (word == 0) {
+      if (++w >= s->used) return 0;
+      word = s->words[w];
+   }
+   return w * 64 + __builtin_ctzll(word);
+}
+
+void uidset_init(struct UidSet *s) {
+   s->ranges = NULL;
+   s->size = 0;
+   s->len = 0;
+   s->count = 0;
+}
+
+void uidset_free(struct UidSet *s) {
+   free(s->ranges);
+   uidset_init(s);
+}
+
+void uidset_clear(struct UidSet *s) {
+   s->len = 0;
+   s->count = 0;
+}
+
+// index of the first range ending at or above uid, len if none
+static size_t find(const struct UidSet *s, unsigned long uid) {
+   size_t lo = 0, hi = s->len;
+   while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (s->ranges[mid].hi < uid) lo = mid + 1;
+      else hi = mid;
+   }
+   return lo;
+}
+
+// opens a gap at ranges[i]; -1 if the array cannot grow
+static int insert(struct UidSet *s, size_t i) {
+   if (s->len == s->size) {
+      const size_t size = s->size > 0 ? s->size * 2 : 16;
+      struct UidRange *ranges = realloc(s->ranges, size * sizeof(struct UidRange));
+      if (ranges == NULL) return -1;
+      s->ranges = ranges;
+      s->size = size;
+   }
+   memmove(&s->ranges[i + 1], &s->ranges[i], (s->len - i) * sizeof(struct UidRange));
+   s->len++;
+   return 0;
+}
+
+// -1 if uid is not a UID or the ranges cannot grow
+int uidset_add(struct UidSet *s, unsigned long uid) {
+   if (uid == 0 || uid > UINT32_MAX) return -1;
+
+   const size_t i = find(s, uid);
+   if (i < s->len && s->ranges[i].lo <= uid) return 0;
+
+   const bool prev = i > 0 && s->ranges[i - 1].hi + 1 == uid;
+   const bool next = i < s->len && s->ranges[i].lo == uid + 1;
+   if (prev && next) {
+      s->ranges[i - 1].hi = s->ranges[i].hi;
+      memmove(&s->ranges[i], &s->ranges[i + 1], (s->len - i - 1) * sizeof(struct UidRange));
+      s->len--;
+   } else if (prev) {
+      s->ranges[i - 1].hi = uid;
+   } else if (next) {
+      s->ranges[i].lo = uid;
+   } else {
+      if (insert(s, i) == -1) return -1;
+      s->ranges[i].lo = s->ranges[i].hi = uid;
+   }
+   s->count++;
+   return 0;
+}
+
+// removes lo to hi; -1 if that splits a range and the ranges cannot grow
+int uidset_remove(struct UidSet *s, unsigned long lo, unsigned long hi) {
+   if (lo == 0) lo = 1;
+   if (hi > UINT32_MAX) hi = UINT32_MAX;
+   if (lo > hi) return 0;
+
+   size_t i = find(s, lo);
+   if (i < s->len && s->ranges[i].lo < lo && s->ranges[i].hi > hi) {
+      if (insert(s, i) == -1) return -1;
+      s->ranges[i].hi = lo - 1;
+      s->ranges[i + 1].lo = hi + 1;
+      s->count -= hi - lo + 1;
+      return 0;
+   }
+   if (i < s->len && s->ranges[i].lo < lo) {
+      s->count -= s->ranges[i].hi - lo + 1;
+      s->ranges[i].hi = lo - 1;
+      i++;
+   }
+
+   size_t j = i;
+   while (j < s->len && s->ranges[j].hi <= hi) {
+      s->count -= s->ranges[j].hi - s->ranges[j].lo + 1;
+      j++;
+   }
+   if (j < s->len && s->ranges[j].lo <= hi) {
+      s->count -= hi - s->ranges[j].lo + 1;
+      s->ranges[j].lo = hi + 1;
+   }
+   memmove(&s->ranges[i], &s->ranges[j], (s->len - j) * sizeof(struct UidRange));
+   s->len -= j - i;
+   return 0;
+}
+
+bool uidset_has(const struct UidSet *s, unsigned long uid) {
+   const size_t i = find(s, uid);
+   return i < s->len && s->ranges[i].lo <= uid;
+}
+
+// the smallest member above after, or 0 if there is none
+unsigned long uidset_next(const struct UidSet *s, unsigned long after) {
+   const size_t i = find(s, after + 1);
+   if (i == s->len) return 0;
+   return s->ranges[i].lo > after ? s->ranges[i].lo : after + 1;
+}
@@ -0,0 +1,58 @@
+#ifndef SEQSET_H
+#define SEQSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A set of IMAP message sequence numbers as a bitmap: bit n is message
+ * n. Sequence numbers are dense (1 to EXISTS), so the map stays small;
+ * membership is one bit test, and an EXPUNGE, which renumbers every
+ * message above the expunged one, shifts the words above it by one bit
+ * instead of rewriting each number. Numbers above SEQSET_MAX are
+ * refused rather than grown to.
+ */
+#define SEQSET_MAX (1UL << 27)
+
+struct SeqSet {
+   uint64_t *words;
+   size_t size;      // words allocated
+   size_t used;      // words up to the highest member
+   size_t count;
+};
+
+/*
+ * A set of UIDs as sorted, disjoint ranges. UIDs never shift but are
+ * sparse and reach up to 2^32 - 1, so memory follows the runs of
+ * members, not the highest one; unseen mail mostly comes in runs.
+ */
+struct UidRange {
+   uint32_t lo, hi;
+};
+
+struct UidSet {
+   struct UidRange *ranges;
+   size_t size;      // ranges allocated
+   size_t len;       // ranges in use
+   size_t count;
+};
+
+void seqset_init(struct SeqSet*);
+void seqset_free(struct SeqSet*);
+void seqset_clear(struct SeqSet*);
+int seqset_add(struct SeqSet*, unsigned long num);
+void seqset_remove(struct SeqSet*, unsigned long num);
+bool seqset_has(const struct SeqSet*, unsigned long num);
+void seqset_expunge(struct SeqSet*, unsigned long num);
+unsigned long seqset_next(const struct SeqSet*, unsigned long after);
+
+void uidset_init(struct UidSet*);
+void uidset_free(struct UidSet*);
+void uidset_clear(struct UidSet*);
+int uidset_add(struct UidSet*, unsigned long uid);
+int uidset_remove(struct UidSet*, unsigned long lo, unsigned long hi);
+bool uidset_has(const struct UidSet*, unsigned long uid);
+unsigned long uidset_next(const struct UidSet*, unsigned long after);
+
+#endif
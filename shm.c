@@ -0,0 +1,185 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "dwmstatus.h"
+#include "dwmstatus-shm.h"
+
+static struct dwmstatus_shm *shm;
+static int mem_fd = -1, event_fd = -1;
+static uint32_t last_generation;
+static time_t last_reap;
+static uint32_t last_seq[DWMSTATUS_SHM_SLOTS];
+static struct Segment *slot_segments[DWMSTATUS_SHM_SLOTS];
+
+static void drop(size_t slot) {
+  struct Segment *s = slot_segments[slot];
+  if (s == NULL)
+    return;
+  for (size_t i = 0; i < DWMSTATUS_SHM_SLOTS; i++)
+    if (slot_segments[i] == s)
+      slot_segments[i] = NULL;
+  segment_remove(s);
+}
+
+/* Frees the slots of producers that exited without releasing them. */
+static void reap(void) {
+  const uint32_t self = (uint32_t) getpid();
+
+  for (size_t i = 0; i < DWMSTATUS_SHM_SLOTS; i++) {
+    struct dwmstatus_shm_slot *slot = &shm->slots[i];
+    uint32_t owner = atomic_load_explicit(&slot->owner, memory_order_relaxed);
+    if (owner == 0 || !dwmstatus_shm_dead(owner))
+      continue;
+    /* a producer that took the slot over meanwhile keeps it */
+    if (!atomic_compare_exchange_strong(&slot->owner, &owner, self))
+      continue;
+    /* held as ours, seq is made even in case the producer died mid-write */
+    atomic_fetch_or(&slot->seq, 1);
+    atomic_fetch_add(&slot->seq, 1);
+    atomic_store(&slot->owner, 0);
+    drop(i);
+  }
+}
+
+static void on_event(int fd, uint32_t events, void *arg) {
+  uint64_t count;
+  if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    perror("shm: eventfd");
+  shmseg_poll();
+}
+
+/* Creates the slot region handed out to producers. Returns -1 on failure. */
+int shmseg_open(void) {
+  mem_fd = memfd_create("dwmstatus", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (mem_fd == -1 || ftruncate(mem_fd, sizeof(*shm)) == -1) {
+    perror("shm: memfd");
+    goto fail;
+  }
+  /* producers must not be able to shrink the region under our mapping */
+  fcntl(mem_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+  shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+  if (shm == MAP_FAILED) {
+    perror("shm: mmap");
+    shm = NULL;
+    goto fail;
+  }
+  shm->magic = DWMSTATUS_SHM_MAGIC;
+  shm->nslots = DWMSTATUS_SHM_SLOTS;
+
+  event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd == -1 || loop_add(event_fd, EPOLLIN, on_event, NULL) == -1) {
+    perror("shm: eventfd");
+    goto fail;
+  }
+  return 0;
+
+fail:
+  if (shm != NULL)
+    munmap(shm, sizeof(*shm));
+  if (mem_fd != -1)
+    close(mem_fd);
+  if (event_fd != -1)
+    close(event_fd);
+  shm = NULL;
+  mem_fd = event_fd = -1;
+  return -1;
+}
+
+/* Answers a DWMSTATUS_SHM_REQUEST on sock with the region and eventfd. */
+int shmseg_send(int sock) {
+  if (shm == NULL)
+    return -1;
+
+  const int fds[2] = { mem_fd, event_fd };
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } control;
+  struct iovec iov = { "shm", 3 };
+  struct msghdr msg = {
+    .msg_iov = &iov, .msg_iovlen = 1,
+    .msg_control = control.buf, .msg_controllen = sizeof(control.buf),
+  };
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  if (sendmsg(sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+    perror("shm: sendmsg");
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Applies the slots that changed since the last call. Costs one load
+ * when no producer wrote anything; slots caught mid-write are retried
+ * on the next call. Once a second the owners are checked for liveness.
+ */
+void shmseg_poll(void) {
+  if (shm == NULL)
+    return;
+
+  const time_t now = time(NULL);
+  if (now != last_reap) {
+    last_reap = now;
+    reap();
+  }
+
+  const uint32_t generation = atomic_load_explicit(&shm->generation, memory_order_acquire);
+  if (generation == last_generation)
+    return;
+  last_generation = generation;
+
+  for (size_t i = 0; i < DWMSTATUS_SHM_SLOTS; i++) {
+    struct dwmstatus_shm_slot *slot = &shm->slots[i];
+    const uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq == last_seq[i])
+      continue;
+    if (seq & 1) {
+      last_generation--;
+      continue;
+    }
+
+    char name[DWMSTATUS_SHM_NAME_MAX], text[DWMSTATUS_SHM_TEXT_MAX];
+    size_t len = slot->len;
+    if (len > sizeof(text))
+      len = sizeof(text);
+    memcpy(name, slot->name, sizeof(name));
+    memcpy(text, slot->text, len);
+    const bool owned = atomic_load_explicit(&slot->owner, memory_order_relaxed) != 0;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+      last_generation--;
+      continue;
+    }
+    last_seq[i] = seq;
+    name[sizeof(name) - 1] = '\0';
+
+    struct Segment *s = slot_segments[i];
+    if (!owned || len == 0 || name[0] == '\0' || strchr(name, '/') != NULL) {
+      drop(i);
+      continue;
+    }
+    if (s != NULL && strcmp(s->name, name) != 0) {
+      drop(i);
+      s = NULL;
+    }
+    if (s == NULL && (s = slot_segments[i] = segment_add(name, SegShm)) == NULL)
+      continue;
+    segment_set(s, text, len);
+  }
+}
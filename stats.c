@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dwmstatus.h"
+
+/*
+ * Counters and latency histograms. Counters are always kept; timing
+ * only starts once someone asks for the stats (SIGUSR1 or a "\nstats"
+ * request on the push socket), so until then the hot path pays a
+ * predictable branch per probe and no clock reads.
+ *
+ * Histograms are log-linear like HdrHistogram: a bucket per power of two
+ * of nanoseconds, split into SUB_BUCKETS linear steps, which keeps the
+ * relative error of any percentile under 1/SUB_BUCKETS.
+ */
+
+#define SUB_BITS 3
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKETS (64 * SUB_BUCKETS)
+
+struct Histogram {
+  unsigned long long count, max;
+  unsigned counts[BUCKETS];
+};
+
+bool stats_on;
+unsigned long long stats_counters[StatCounters];
+
+static struct Histogram histograms[StatHistograms];
+static long long started;
+
+static const char *const counter_names[StatCounters] = {
+  [StatTicks] = "ticks",
+  [StatRenders] = "renders",
+  [StatPublishes] = "publishes",
+  [StatSuppressed] = "suppressed",
+  [StatReads] = "reads",
+};
+
+static const char *const histogram_names[StatHistograms] = {
+  [StatRender] = "render",
+  [StatOutput] = "output",
+  [StatRead] = "read",
+  [StatLatency] = "latency",
+};
+
+long long stats_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+static size_t bucket(unsigned long long v) {
+  if (v < SUB_BUCKETS)
+    return v;
+  const int msb = 63 - __builtin_clzll(v);
+  return (msb - SUB_BITS + 1) * SUB_BUCKETS + ((v >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/* Upper bound of the values counted in bucket b. */
+static unsigned long long bucket_value(size_t b) {
+  if (b < SUB_BUCKETS)
+    return b;
+  const int shift = b / SUB_BUCKETS - 1;
+  return ((unsigned long long) (SUB_BUCKETS + b % SUB_BUCKETS + 1) << shift) - 1;
+}
+
+/* Start time for stats_record, or 0 while timing is off. */
+long long stats_start(void) {
+  return stats_on ? stats_clock() : 0;
+}
+
+/* Adds the time since start (from stats_start) to histogram h. */
+void stats_record(enum StatHistogram h, long long start) {
+  if (!stats_on || start == 0)
+    return;
+  struct Histogram *hist = &histograms[h];
+  const long long d = stats_clock() - start;
+  const unsigned long long v = d > 0 ? d : 0;
+  hist->counts[bucket(v)]++;
+  hist->count++;
+  if (v > hist->max)
+    hist->max = v;
+}
+
+static unsigned long long percentile(const struct Histogram *h, double p) {
+  unsigned long long want = h->count * p, seen = 0;
+  for (size_t b = 0; b < BUCKETS; b++)
+    if ((seen += h->counts[b]) > want)
+      return bucket_value(b) < h->max ? bucket_value(b) : h->max;
+  return h->max;
+}
+
+/* Starts timing if it was off. Returns true if it already was on. */
+static bool enable(void) {
+  if (stats_on)
+    return true;
+  stats_on = true;
+  started = stats_clock();
+  return false;
+}
+
+/*
+ * Formats the stats into buf and turns timing on. Returns the length,
+ * which is less than size.
+ */
+size_t stats_format(char *buf, size_t size) {
+  size_t len = 0;
+#define OUT(...) do { \
+    const int n = snprintf(buf + len, size - len, __VA_ARGS__); \
+    if (n > 0) \
+      len = len + n < size ? len + n : size - 1; \
+  } while (0)
+
+  const long long now = stats_clock();
+  if (!enable())
+    OUT("timing starts now\n");
+  for (size_t i = 0; i < StatCounters; i++)
+    OUT("%s%s %llu", i > 0 ? "  " : "", counter_names[i], stats_counters[i]);
+  OUT("\n");
+
+  if (now > started)
+    OUT("timed for %.1f s, in us:\n", (now - started) / 1e9);
+  for (size_t i = 0; i < StatHistograms; i++) {
+    const struct Histogram *h = &histograms[i];
+    OUT("%-8s n %-8llu p50 %-9.1f p90 %-9.1f p99 %-9.1f max %.1f\n", histogram_names[i], h->count,
+	percentile(h, 0.5) / 1e3, percentile(h, 0.9) / 1e3, percentile(h, 0.99) / 1e3, h->max / 1e3);
+  }
+
+  for (size_t i = 0; i < segment_count(); i++) {
+    const struct Segment *s = segment_at(i);
+    if (s->refreshed > 0)
+      OUT("segment %-16s age %.1f s\n", s->name, (now - s->refreshed) / 1e9);
+    else
+      OUT("segment %-16s age ?\n", s->name);
+  }
+#undef OUT
+  return len;
+}
+
+/* Writes the stats to stderr, e.g. on SIGUSR1. */
+void stats_dump(void) {
+  char buf[8192];
+  const size_t len = stats_format(buf, sizeof(buf));
+  if (write(STDERR_FILENO, buf, len) == -1)
+    perror("stats");
+}
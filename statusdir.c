@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "dwmstatus.h"
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE \
+		    | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/*
+ * Status files stay open once seen, and all reads that are due are done
+ * as one reader_batch, which with io_uring is a single system call. A
+ * file is reopened only when a new one is moved in under its name.
+ * Without inotify, the directory's mtime tells whether it has to be
+ * scanned again, so an unchanged directory costs a fstat and one batch.
+ */
+
+struct DirFile {
+  struct Segment *segment;
+  int fd;
+  bool pending;
+  char buf[STATUS_SIZE];
+};
+
+static int inotify_fd = -1, dir_fd = -1;
+static struct timespec dir_mtime;
+static struct DirFile files[MAX_SEGMENTS];
+static size_t nfiles;
+
+static int filter(const struct dirent *entry) {
+  return entry->d_type == DT_REG;
+}
+
+static struct DirFile *find_file(const char *name) {
+  for (size_t i = 0; i < nfiles; i++)
+    if (strcmp(files[i].segment->name, name) == 0)
+      return &files[i];
+  return NULL;
+}
+
+/* Closes name and drops its segment. */
+static void forget(const char *name) {
+  struct DirFile *f = find_file(name);
+  struct Segment *s = segment_get(name);
+
+  if (f != NULL) {
+    close(f->fd);
+    *f = files[--nfiles];
+  }
+  if (s != NULL && s->owner == SegDir)
+    segment_remove(s);
+}
+
+/* Marks name to be read by the next flush, opening it if needed. */
+static void queue(const char *name, bool reopen) {
+  struct Segment *s;
+  struct stat st;
+
+  /* the name may already be taken by a segment pushed over the socket */
+  if ((s = segment_get(name)) != NULL && s->owner != SegDir)
+    return;
+
+  struct DirFile *f = find_file(name);
+  if (f != NULL && !reopen) {
+    f->pending = true;
+    return;
+  }
+
+  const int fd = open(name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+    if (fd != -1)
+      close(fd);
+    forget(name);
+    return;
+  }
+  if (f == NULL) {
+    if ((s = segment_add(name, SegDir)) == NULL) {
+      close(fd);
+      return;
+    }
+    f = &files[nfiles++];
+    f->segment = s;
+  } else {
+    close(f->fd);
+  }
+  f->fd = fd;
+  f->pending = true;
+}
+
+/* Reads every queued file and updates its segment. */
+static void flush(void) {
+  struct ReadOp ops[MAX_SEGMENTS];
+  struct DirFile *owner[MAX_SEGMENTS];
+  size_t n = 0;
+
+  for (size_t i = 0; i < nfiles; i++) {
+    if (files[i].pending) {
+      files[i].pending = false;
+      owner[n] = &files[i];
+      ops[n++] = (struct ReadOp) { files[i].fd, files[i].buf, sizeof(files[i].buf), 0 };
+    }
+  }
+  const long long start = stats_start();
+  reader_batch(ops, n);
+  stats_record(StatRead, start);
+  stats_counters[StatReads] += n;
+
+  for (size_t i = 0; i < n; i++) {
+    if (ops[i].res < 0) {
+      fprintf(stderr, "read error: %s (%d)\n", owner[i]->segment->name, (int) -ops[i].res);
+      continue;
+    }
+    segment_set(owner[i]->segment, owner[i]->buf, ops[i].res);
+  }
+}
+
+/* Full scandir pass; used at startup, on queue overflow and without inotify. */
+static int rescan(void) {
+  struct dirent **namelist;
+  const int n = scandir(".", &namelist, filter, alphasort);
+  if (n == -1) {
+    perror("scandir");
+    return -1;
+  }
+
+  /* both lists are sorted by name, so stale segments fall out of a merge walk */
+  size_t si = 0;
+  for (int i = 0; i <= n; i++) {
+    struct Segment *s;
+    while (si < segment_count()) {
+      s = segment_at(si);
+      if (i < n && strcmp(s->name, namelist[i]->d_name) >= 0)
+	break;
+      if (s->owner == SegDir)
+	forget(s->name);
+      else
+	si++;
+    }
+
+    if (i < n) {
+      /* files replaced while unwatched would still be read through the old fd */
+      queue(namelist[i]->d_name, true);
+      if (segment_get(namelist[i]->d_name) != NULL)
+	si++;
+      free(namelist[i]);
+    }
+  }
+  free(namelist);
+
+  flush();
+  return 0;
+}
+
+/*
+ * Loads the current directory and, with watch, starts watching it.
+ * Returns the inotify descriptor, or -1 if statusdir_update has to fall
+ * back to rescanning the directory on every call.
+ */
+int statusdir_open(bool watch) {
+  if (!watch) {
+    inotify_fd = -1;
+  } else if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+    perror("inotify_init1");
+  } else if (inotify_add_watch(inotify_fd, ".", WATCH_MASK | IN_ONLYDIR) == -1) {
+    perror("inotify_add_watch");
+    close(inotify_fd);
+    inotify_fd = -1;
+  }
+
+  reader_init();
+  if ((dir_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+    perror("open status directory");
+    return -2;
+  }
+  if (rescan() == -1)
+    return -2;
+  return inotify_fd;
+}
+
+/* Without inotify: rescans if the directory changed, else rereads all files. */
+static int poll_dir(void) {
+  struct stat st;
+  struct timespec now;
+
+  if (fstat(dir_fd, &st) == -1) {
+    perror("status directory");
+    return -1;
+  }
+  /*
+   * Entries added within the mtime granularity of the last scan would go
+   * unnoticed, so a recently changed directory is scanned every time.
+   */
+  clock_gettime(CLOCK_REALTIME, &now);
+  if (st.st_mtim.tv_sec != dir_mtime.tv_sec || st.st_mtim.tv_nsec != dir_mtime.tv_nsec
+      || now.tv_sec - st.st_mtim.tv_sec < 2) {
+    dir_mtime = st.st_mtim;
+    return rescan();
+  }
+
+  for (size_t i = 0; i < nfiles; i++)
+    files[i].pending = true;
+  flush();
+  return 0;
+}
+
+/* Rereads the whole directory, e.g. on SIGHUP. */
+int statusdir_reload(void) {
+  return rescan();
+}
+
+/*
+ * Applies pending directory changes to the segment table, re-reading
+ * only the files that were written or moved in. Returns -1 if the
+ * directory became unusable.
+ */
+int statusdir_update(void) {
+  if (inotify_fd == -1)
+    return poll_dir();
+
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+
+  while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + len;) {
+      const struct inotify_event *ev = (const struct inotify_event *) p;
+      p += sizeof(*ev) + ev->len;
+
+      if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+	fprintf(stderr, "status directory is gone\n");
+	return -1;
+      }
+      if (ev->mask & IN_Q_OVERFLOW) {
+	if (rescan() == -1)
+	  return -1;
+	continue;
+      }
+      if (ev->len == 0 || (ev->mask & IN_ISDIR))
+	continue;
+
+      if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+	queue(ev->name, ev->mask & IN_MOVED_TO);
+      else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+	forget(ev->name);
+    }
+  }
+  flush();
+
+  if (len == -1 && errno != EAGAIN && errno != EINTR) {
+    perror("inotify read");
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "dwmstatus.h"
+
+/*
+ * Tail sources keep their file open and only pread what was appended
+ * since the last read, so a growing log costs O(new bytes) per update.
+ * The window holds the most recent bytes; truncation restarts it and a
+ * replaced file (rotation) is drained and then reopened by name.
+ */
+
+#define MAX_TAILS 8
+#define TAIL_WINDOW 4096
+#define FILE_MASK (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#define DIR_MASK (IN_CREATE | IN_MOVED_TO)
+
+struct TailState {
+  const struct Tail *cfg;
+  char base[NAME_MAX + 1];
+  int fd, file_wd, dir_wd;
+  dev_t dev;
+  ino_t ino;
+  off_t offset;
+  size_t len;
+  char window[TAIL_WINDOW];
+  struct Segment *segment;
+};
+
+static struct TailState tails[MAX_TAILS];
+static size_t ntails;
+static int inotify_fd = -1;
+
+/* Reads everything appended since the last call into the window. */
+static void read_new(struct TailState *t) {
+  struct stat st;
+  if (fstat(t->fd, &st) == -1)
+    return;
+
+  if (st.st_size < t->offset) {
+    /* truncated in place */
+    t->offset = 0;
+    t->len = 0;
+  }
+  if (st.st_size - t->offset > TAIL_WINDOW) {
+    /* older bytes could never be shown, so skip them */
+    t->offset = st.st_size - TAIL_WINDOW;
+    t->len = 0;
+  }
+
+  size_t want = st.st_size - t->offset;
+  if (t->len + want > TAIL_WINDOW) {
+    const size_t drop = t->len + want - TAIL_WINDOW;
+    memmove(t->window, t->window + drop, t->len - drop);
+    t->len -= drop;
+  }
+
+  while (want > 0) {
+    const ssize_t r = pread(t->fd, t->window + t->len, want, t->offset);
+    if (r == -1 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      break;
+    t->len += r;
+    t->offset += r;
+    want -= r;
+  }
+}
+
+/* Shows the last cfg->lines complete lines of the window. */
+static void show(struct TailState *t) {
+  const char *end = memrchr(t->window, '\n', t->len);
+  if (end == NULL) {
+    segment_set(t->segment, "", 0);
+    return;
+  }
+  end++;
+
+  const char *start = end - 1;
+  for (int n = 0; n < t->cfg->lines; n++) {
+    const char *nl = start > t->window ? memrchr(t->window, '\n', start - t->window) : NULL;
+    if (nl == NULL) {
+      start = t->window;
+      break;
+    }
+    start = n + 1 < t->cfg->lines ? nl : nl + 1;
+  }
+  if (end - start > STATUS_SIZE)
+    start = end - STATUS_SIZE;
+  segment_set(t->segment, start, end - start);
+}
+
+static void reopen(struct TailState *t) {
+  struct stat st;
+
+  if (t->fd != -1) {
+    close(t->fd);
+    inotify_rm_watch(inotify_fd, t->file_wd);
+    t->fd = t->file_wd = -1;
+  }
+
+  t->fd = open(t->cfg->path, O_RDONLY | O_CLOEXEC);
+  if (t->fd == -1)
+    return;
+  if (fstat(t->fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+    close(t->fd);
+    t->fd = -1;
+    return;
+  }
+  t->dev = st.st_dev;
+  t->ino = st.st_ino;
+  t->offset = 0;
+  t->len = 0;
+  t->file_wd = inotify_add_watch(inotify_fd, t->cfg->path, FILE_MASK);
+}
+
+static void refresh(struct TailState *t) {
+  struct stat st;
+
+  if (t->fd != -1 && (stat(t->cfg->path, &st) == -1 || st.st_ino != t->ino || st.st_dev != t->dev)) {
+    /* rotated: take what was still written to the old file first */
+    read_new(t);
+    reopen(t);
+  } else if (t->fd == -1) {
+    reopen(t);
+  }
+
+  if (t->fd != -1)
+    read_new(t);
+  show(t);
+}
+
+static void on_inotify(int fd, uint32_t events, void *arg) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool due[MAX_TAILS] = { false };
+  ssize_t len;
+
+  while ((len = read(fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + len;) {
+      const struct inotify_event *ev = (const struct inotify_event *) p;
+      p += sizeof(*ev) + ev->len;
+
+      for (size_t i = 0; i < ntails; i++) {
+	if (ev->mask & IN_Q_OVERFLOW)
+	  due[i] = true;
+	else if (ev->wd == tails[i].file_wd)
+	  due[i] = true;
+	else if (ev->wd == tails[i].dir_wd && ev->len > 0 && strcmp(ev->name, tails[i].base) == 0)
+	  due[i] = true;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < ntails; i++)
+    if (due[i])
+      refresh(&tails[i]);
+}
+
+/* Starts following the configured tail sources. Returns -1 on failure. */
+int tail_open(const struct Tail *cfg, size_t n) {
+  if (n == 0)
+    return 0;
+  if (n > MAX_TAILS) {
+    fprintf(stderr, "tail: too many sources (%zu)\n", n);
+    return -1;
+  }
+
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd == -1 || loop_add(inotify_fd, EPOLLIN, on_inotify, NULL) == -1) {
+    perror("tail: inotify");
+    return -1;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    struct TailState *t = &tails[ntails];
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s", cfg[i].path);
+    snprintf(t->base, sizeof(t->base), "%s", basename(path));
+    snprintf(path, sizeof(path), "%s", cfg[i].path);
+    t->cfg = &cfg[i];
+    t->fd = t->file_wd = -1;
+    if ((t->segment = segment_add(t->base, SegTail)) == NULL)
+      continue;
+
+    /* the directory watch notices the file being created or rotated in */
+    t->dir_wd = inotify_add_watch(inotify_fd, dirname(path), DIR_MASK | IN_ONLYDIR);
+    ntails++;
+    refresh(t);
+  }
+  return 0;
+}
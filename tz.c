@@ -0,0 +1,562 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "dwmstatus.h"
+
+#define MAX_ZONES 16
+#define TZ_ABBR_MAX 16
+#define TZDIR_DEFAULT "/usr/share/zoneinfo"
+#define LOCALTIME "/etc/localtime"
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+#define LOCALTIME_DIR_MASK (IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE)
+
+struct ZoneType {
+  int32_t utoff;
+  bool isdst;
+  uint8_t abbr;
+};
+
+/* One transition rule of a POSIX TZ string: Jn, n or Mm.w.d, plus time of day. */
+struct Rule {
+  char kind;
+  int day, week, mon;
+  int32_t time;
+};
+
+struct Posix {
+  int32_t std_off, dst_off;
+  char std_abbr[TZ_ABBR_MAX], dst_abbr[TZ_ABBR_MAX];
+  bool has_dst;
+  struct Rule start, end;
+};
+
+struct Zone {
+  char name[SEGMENT_NAME_MAX];
+  char path[PATH_MAX];
+  bool loaded;
+
+  int64_t *trans;
+  uint8_t *trans_idx;
+  size_t ntrans;
+  struct ZoneType *types;
+  size_t ntypes;
+  char *chars;
+  size_t nchars;
+  struct Posix footer;
+  bool has_footer;
+
+  /* the interval [lo, hi) of the last lookup shares one offset */
+  int64_t lo, hi;
+  int32_t off;
+  bool isdst;
+  const char *abbr;
+};
+
+static struct Zone zones[MAX_ZONES];
+static size_t nzones;
+static int inotify_fd = -1;
+static int wds[MAX_ZONES + 1];
+static size_t nwds;
+
+static int64_t floor_div(int64_t a, int64_t b) {
+  return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static bool is_leap(int64_t y) {
+  return y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant). */
+static int64_t days_from_civil(int64_t y, int m, int d) {
+  y -= m <= 2;
+  const int64_t era = floor_div(y, 400);
+  const int64_t yoe = y - era * 400;
+  const int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int64_t *y, int *m, int *d) {
+  z += 719468;
+  const int64_t era = floor_div(z, 146097);
+  const int64_t doe = z - era * 146097;
+  const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const int64_t mp = (5 * doy + 2) / 153;
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = yoe + era * 400 + (*m <= 2);
+}
+
+static uint32_t be32(const unsigned char *p) {
+  return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static int64_t be64(const unsigned char *p) {
+  return (int64_t) ((uint64_t) be32(p) << 32 | be32(p + 4));
+}
+
+/* [+-]hh[:mm[:ss]] */
+static const char *parse_hms(const char *s, int32_t *out) {
+  int sign = 1, h = 0, m = 0, sec = 0;
+  if (*s == '+' || *s == '-')
+    sign = *s++ == '-' ? -1 : 1;
+  if (*s < '0' || *s > '9')
+    return NULL;
+  while (*s >= '0' && *s <= '9')
+    h = h * 10 + *s++ - '0';
+  if (*s == ':') {
+    s++;
+    while (*s >= '0' && *s <= '9')
+      m = m * 10 + *s++ - '0';
+    if (*s == ':') {
+      s++;
+      while (*s >= '0' && *s <= '9')
+	sec = sec * 10 + *s++ - '0';
+    }
+  }
+  *out = sign * (h * 3600 + m * 60 + sec);
+  return s;
+}
+
+static const char *parse_abbr(const char *s, char *abbr) {
+  size_t n = 0;
+  if (*s == '<') {
+    s++;
+    while (*s != '\0' && *s != '>')
+      if (n < TZ_ABBR_MAX - 1)
+	abbr[n++] = *s++;
+      else
+	s++;
+    if (*s++ != '>')
+      return NULL;
+  } else {
+    while ((*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z'))
+      if (n < TZ_ABBR_MAX - 1)
+	abbr[n++] = *s++;
+      else
+	s++;
+  }
+  abbr[n] = '\0';
+  return n < 3 ? NULL : s;
+}
+
+static const char *parse_rule(const char *s, struct Rule *r) {
+  r->time = 2 * 3600;
+  if (*s == 'M') {
+    r->kind = 'M';
+    if (sscanf(s + 1, "%d.%d.%d", &r->mon, &r->week, &r->day) != 3
+	|| r->mon < 1 || r->mon > 12 || r->week < 1 || r->week > 5
+	|| r->day < 0 || r->day > 6)
+      return NULL;
+    s++;
+    while ((*s >= '0' && *s <= '9') || *s == '.')
+      s++;
+  } else {
+    r->kind = *s == 'J' ? 'J' : 'D';
+    if (*s == 'J')
+      s++;
+    if (*s < '0' || *s > '9')
+      return NULL;
+    r->day = 0;
+    while (*s >= '0' && *s <= '9')
+      r->day = r->day * 10 + *s++ - '0';
+  }
+  if (*s == '/')
+    s = parse_hms(s + 1, &r->time);
+  return s;
+}
+
+/* POSIX TZ string, e.g. "EST5EDT,M3.2.0,M11.1.0"; offsets are west-positive. */
+static bool parse_posix(const char *s, struct Posix *p) {
+  int32_t off;
+
+  if ((s = parse_abbr(s, p->std_abbr)) == NULL || (s = parse_hms(s, &off)) == NULL)
+    return false;
+  p->std_off = -off;
+  p->has_dst = *s != '\0';
+  if (!p->has_dst)
+    return true;
+
+  if ((s = parse_abbr(s, p->dst_abbr)) == NULL)
+    return false;
+  p->dst_off = p->std_off + 3600;
+  if (*s != ',' && *s != '\0') {
+    if ((s = parse_hms(s, &off)) == NULL)
+      return false;
+    p->dst_off = -off;
+  }
+  if (*s == '\0')
+    s = ",M3.2.0,M11.1.0";
+  if (*s++ != ',' || (s = parse_rule(s, &p->start)) == NULL
+      || *s++ != ',' || (s = parse_rule(s, &p->end)) == NULL)
+    return false;
+  return *s == '\0';
+}
+
+/* Local seconds since the epoch at which rule r fires in year y. */
+static int64_t rule_time(int64_t y, const struct Rule *r) {
+  int64_t days;
+  switch (r->kind) {
+  case 'J':
+    days = days_from_civil(y, 1, 1) + r->day - 1 + (is_leap(y) && r->day >= 60);
+    break;
+  case 'D':
+    days = days_from_civil(y, 1, 1) + r->day;
+    break;
+  default:
+    days = days_from_civil(y, r->mon, 1);
+    int64_t wday = floor_div(days + 4, 7) * -7 + days + 4;
+    days += (r->day - wday + 7) % 7 + (r->week - 1) * 7;
+    int next = r->mon == 12 ? 13 : r->mon + 1;
+    int64_t month_end = next == 13 ? days_from_civil(y + 1, 1, 1) : days_from_civil(y, next, 1);
+    while (days >= month_end)
+      days -= 7;
+  }
+  return days * 86400 + r->time;
+}
+
+static void lookup_posix(struct Zone *z, int64_t t) {
+  const struct Posix *p = &z->footer;
+
+  if (!p->has_dst) {
+    z->lo = z->ntrans > 0 ? z->trans[z->ntrans - 1] : INT64_MIN;
+    z->hi = INT64_MAX;
+    z->off = p->std_off;
+    z->isdst = false;
+    z->abbr = p->std_abbr;
+    return;
+  }
+
+  /* transitions of the neighbouring years bound the interval containing t */
+  int64_t y, edges[6];
+  bool dst_after[6];
+  int m, d;
+  civil_from_days(floor_div(t + p->std_off, 86400), &y, &m, &d);
+  for (int i = 0; i < 3; i++) {
+    edges[i * 2] = rule_time(y - 1 + i, &p->start) - p->std_off;
+    dst_after[i * 2] = true;
+    edges[i * 2 + 1] = rule_time(y - 1 + i, &p->end) - p->dst_off;
+    dst_after[i * 2 + 1] = false;
+  }
+  for (int i = 1; i < 6; i++)
+    for (int j = i; j > 0 && edges[j] < edges[j - 1]; j--) {
+      int64_t te = edges[j]; edges[j] = edges[j - 1]; edges[j - 1] = te;
+      bool tb = dst_after[j]; dst_after[j] = dst_after[j - 1]; dst_after[j - 1] = tb;
+    }
+
+  int i = 0;
+  while (i < 6 && edges[i] <= t)
+    i++;
+  z->isdst = i > 0 ? dst_after[i - 1] : !dst_after[0];
+  z->lo = i > 0 ? edges[i - 1] : INT64_MIN;
+  z->hi = i < 6 ? edges[i] : INT64_MAX;
+  z->off = z->isdst ? p->dst_off : p->std_off;
+  z->abbr = z->isdst ? p->dst_abbr : p->std_abbr;
+}
+
+static void lookup(struct Zone *z, int64_t t) {
+  if (z->ntrans == 0 || t >= z->trans[z->ntrans - 1]) {
+    if (z->has_footer) {
+      lookup_posix(z, t);
+      if (z->ntrans > 0 && z->lo < z->trans[z->ntrans - 1])
+	z->lo = z->trans[z->ntrans - 1];
+      return;
+    }
+  }
+
+  size_t type = 0, i = 0;
+  z->lo = INT64_MIN;
+  z->hi = z->ntrans > 0 ? z->trans[0] : INT64_MAX;
+  if (z->ntrans > 0 && t >= z->trans[0]) {
+    size_t lo = 0, hi = z->ntrans;
+    while (hi - lo > 1) {
+      size_t mid = (lo + hi) / 2;
+      if (z->trans[mid] <= t)
+	lo = mid;
+      else
+	hi = mid;
+    }
+    i = lo;
+    type = z->trans_idx[i];
+    z->lo = z->trans[i];
+    z->hi = i + 1 < z->ntrans ? z->trans[i + 1] : INT64_MAX;
+  }
+
+  const struct ZoneType *zt = &z->types[type];
+  z->off = zt->utoff;
+  z->isdst = zt->isdst;
+  z->abbr = &z->chars[zt->abbr];
+}
+
+static void unload(struct Zone *z) {
+  free(z->trans);
+  free(z->trans_idx);
+  free(z->types);
+  free(z->chars);
+  z->trans = NULL;
+  z->trans_idx = NULL;
+  z->types = NULL;
+  z->chars = NULL;
+  z->ntrans = z->ntypes = z->nchars = 0;
+  z->has_footer = false;
+  z->loaded = false;
+}
+
+/* Parses a TZif (RFC 8536) file; leap second records are ignored. */
+static bool parse_tzif(struct Zone *z, const unsigned char *buf, size_t size) {
+  const unsigned char *p = buf, *end = buf + size;
+  int tsize = 4;
+
+  if (size < 44 || memcmp(p, "TZif", 4) != 0)
+    return false;
+
+  for (int pass = 0; pass < 2; pass++) {
+    if (end - p < 44 || memcmp(p, "TZif", 4) != 0)
+      return false;
+    const char version = p[4];
+    const uint32_t isutcnt = be32(p + 20), isstdcnt = be32(p + 24), leapcnt = be32(p + 28),
+      timecnt = be32(p + 32), typecnt = be32(p + 36), charcnt = be32(p + 40);
+    p += 44;
+
+    /* every count widened first: a 32-bit product could wrap past the check */
+    const size_t body = (size_t) timecnt * tsize + (size_t) timecnt + (size_t) typecnt * 6
+      + (size_t) charcnt + (size_t) leapcnt * (tsize + 4) + (size_t) isstdcnt + (size_t) isutcnt;
+    if ((size_t) (end - p) < body || typecnt == 0)
+      return false;
+
+    if (pass == 0 && version >= '2') {
+      p += body;
+      tsize = 8;
+      continue;
+    }
+
+    z->trans = malloc(timecnt * sizeof(*z->trans) + 1);
+    z->trans_idx = malloc(timecnt + 1);
+    z->types = malloc(typecnt * sizeof(*z->types));
+    z->chars = malloc(charcnt + 1);
+    if (z->trans == NULL || z->trans_idx == NULL || z->types == NULL || z->chars == NULL)
+      return false;
+
+    for (uint32_t i = 0; i < timecnt; i++, p += tsize)
+      z->trans[i] = tsize == 8 ? be64(p) : (int32_t) be32(p);
+    for (uint32_t i = 0; i < timecnt; i++, p++) {
+      if (*p >= typecnt)
+	return false;
+      z->trans_idx[i] = *p;
+    }
+    for (uint32_t i = 0; i < typecnt; i++, p += 6) {
+      z->types[i].utoff = (int32_t) be32(p);
+      z->types[i].isdst = p[4];
+      z->types[i].abbr = p[5] < charcnt ? p[5] : 0;
+    }
+    memcpy(z->chars, p, charcnt);
+    z->chars[charcnt] = '\0';
+    p += charcnt + leapcnt * (tsize + 4) + isstdcnt + isutcnt;
+    z->ntrans = timecnt;
+    z->ntypes = typecnt;
+    z->nchars = charcnt;
+
+    if (tsize == 8 && p < end && *p == '\n') {
+      const unsigned char *nl = memchr(p + 1, '\n', end - p - 1);
+      char footer[128];
+      if (nl != NULL && (size_t) (nl - p - 1) < sizeof(footer)) {
+	memcpy(footer, p + 1, nl - p - 1);
+	footer[nl - p - 1] = '\0';
+	z->has_footer = footer[0] != '\0' && parse_posix(footer, &z->footer);
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+static bool load(struct Zone *z) {
+  unload(z);
+  z->lo = z->hi = 0;
+
+  if (strcmp(z->name, "UTC") == 0) {
+    z->has_footer = parse_posix("UTC0", &z->footer);
+    z->path[0] = '\0';
+    return z->loaded = true;
+  }
+
+  int fd = open(z->path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    /* not a zoneinfo file; maybe a POSIX TZ string such as "EST5EDT" */
+    if (parse_posix(z->name, &z->footer)) {
+      z->has_footer = true;
+      z->path[0] = '\0';
+      return z->loaded = true;
+    }
+    fprintf(stderr, "tz: cannot open %s (%d)\n", z->path, errno);
+    return false;
+  }
+
+  struct stat st;
+  unsigned char *buf = NULL;
+  bool ok = false;
+  if (fstat(fd, &st) == 0 && st.st_size > 0 && (buf = malloc(st.st_size)) != NULL) {
+    size_t len = 0;
+    ssize_t r;
+    while (len < (size_t) st.st_size && (r = read(fd, buf + len, st.st_size - len)) > 0)
+      len += r;
+    ok = parse_tzif(z, buf, len);
+  }
+  free(buf);
+  close(fd);
+
+  if (!ok) {
+    fprintf(stderr, "tz: invalid zoneinfo file %s\n", z->path);
+    unload(z);
+    return false;
+  }
+  return z->loaded = true;
+}
+
+/* (Re)establishes the watches; files are usually replaced rather than written. */
+static void watch(void) {
+  bool local = false;
+
+  for (size_t i = 0; i < nwds; i++)
+    inotify_rm_watch(inotify_fd, wds[i]);
+  nwds = 0;
+
+  for (size_t i = 0; i < nzones; i++) {
+    if (zones[i].path[0] == '\0')
+      continue;
+    if ((wds[nwds] = inotify_add_watch(inotify_fd, zones[i].path, WATCH_MASK)) == -1)
+      fprintf(stderr, "tz: cannot watch %s (%d)\n", zones[i].path, errno);
+    else
+      nwds++;
+    if (strcmp(zones[i].path, LOCALTIME) == 0)
+      local = true;
+  }
+  /* /etc/localtime is a symlink that gets replaced, so watch its directory too */
+  if (local && (wds[nwds] = inotify_add_watch(inotify_fd, "/etc", LOCALTIME_DIR_MASK | IN_ONLYDIR)) != -1)
+    nwds++;
+}
+
+/* Starts watching zoneinfo files for changes; returns the inotify descriptor. */
+int tz_open(void) {
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd == -1)
+    perror("tz: inotify_init1");
+  return inotify_fd;
+}
+
+/*
+ * Returns the zone called name, loading it on first use. A NULL name is
+ * the local zone from $TZ or /etc/localtime, "UTC" needs no file, other
+ * names are looked up below $TZDIR unless they are absolute paths.
+ */
+struct Zone *tz_get(const char *name) {
+  if (name == NULL)
+    name = getenv("TZ") != NULL && getenv("TZ")[0] != '\0' ? getenv("TZ") : LOCALTIME;
+  if (name[0] == ':')
+    name++;
+
+  for (size_t i = 0; i < nzones; i++)
+    if (strcmp(zones[i].name, name) == 0)
+      return &zones[i];
+
+  if (nzones == MAX_ZONES || strlen(name) >= sizeof(zones[0].name)) {
+    fprintf(stderr, "tz: cannot add zone %s\n", name);
+    return NULL;
+  }
+
+  struct Zone *z = &zones[nzones];
+  strcpy(z->name, name);
+  if (name[0] == '/') {
+    snprintf(z->path, sizeof(z->path), "%s", name);
+  } else {
+    const char *dir = getenv("TZDIR");
+    snprintf(z->path, sizeof(z->path), "%s/%s", dir != NULL ? dir : TZDIR_DEFAULT, name);
+  }
+  if (!load(z))
+    return NULL;
+
+  nzones++;
+  if (inotify_fd != -1 && z->path[0] != '\0')
+    watch();
+  return z;
+}
+
+/* Converts t to broken-down time in zone z without touching TZ or files. */
+void tz_localtime(struct Zone *z, time_t t, struct tm *tm) {
+  if (!z->loaded || t < z->lo || t >= z->hi) {
+    if (z->loaded) {
+      lookup(z, t);
+    } else {
+      z->lo = INT64_MIN;
+      z->hi = INT64_MAX;
+      z->off = 0;
+      z->isdst = false;
+      z->abbr = "UTC";
+    }
+  }
+
+  const int64_t local = (int64_t) t + z->off;
+  const int64_t days = floor_div(local, 86400);
+  const int64_t secs = local - days * 86400;
+  int64_t y;
+  int m, d;
+  civil_from_days(days, &y, &m, &d);
+
+  tm->tm_sec = secs % 60;
+  tm->tm_min = secs / 60 % 60;
+  tm->tm_hour = secs / 3600;
+  tm->tm_mday = d;
+  tm->tm_mon = m - 1;
+  tm->tm_year = y - 1900;
+  tm->tm_wday = floor_div(days + 4, 7) * -7 + days + 4;
+  tm->tm_yday = days - days_from_civil(y, 1, 1);
+  tm->tm_isdst = z->isdst;
+  tm->tm_gmtoff = z->off;
+  tm->tm_zone = z->abbr;
+}
+
+/*
+ * Drains pending zoneinfo change notifications and reloads every zone
+ * if one of their files changed. Returns true if zones were reloaded.
+ */
+bool tz_update(void) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool changed = false;
+  ssize_t len;
+
+  if (inotify_fd == -1)
+    return false;
+
+  while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + len;) {
+      const struct inotify_event *ev = (const struct inotify_event *) p;
+      p += sizeof(*ev) + ev->len;
+      if (ev->mask & IN_IGNORED)
+	continue;
+      if (ev->len == 0 || strcmp(ev->name, "localtime") == 0)
+	changed = true;
+    }
+  }
+  if (!changed)
+    return false;
+
+  tz_reload();
+  return true;
+}
+
+/* Reloads every zone from its file, e.g. on SIGHUP. */
+void tz_reload(void) {
+  for (size_t i = 0; i < nzones; i++)
+    load(&zones[i]);
+  if (inotify_fd != -1)
+    watch();
+}